@@ -0,0 +1,525 @@
+#include <string.h>
+#include "apu.h"
+#include "cpu.h"
+#include "audio.h"
+#include "capture.h"
+
+// DMG sound: two square channels (the first with frequency sweep), a wave
+// channel and a noise channel. Registers live in cpu->memory like every
+// other I/O register; apu_write keeps the channel state in sync with them.
+//
+// The frame sequencer (length, sweep, envelope) is clocked by DIV like on
+// hardware and always runs, since it's visible to games through NR52 and
+// the sweep's frequency write-back. Channel timers and synthesis only
+// produce sound, which games can't read back, so without an audio sink
+// they're skipped entirely.
+//
+// Channels don't run every tick: update_apu only counts T-cycles until the
+// next audible waveform step (or a register access) and then catches them
+// all up at once, handing every level change to the band-limited
+// synthesizer as a delta at its T-cycle. Channels that can't be heard
+// (volume 0, DAC off) just have their phase advanced. Samples are pulled
+// out every APU_FRAME_CYCLES.
+
+#define APU_FRAME_CYCLES 8192 // about 94 samples at 48 kHz
+
+// Channel n's registers are NRn0-NRn4 at 0xFF10 + 5n (NR20, NR40 unused)
+#define NRX1(ch) (NR10 + 5 * (ch) + 1)
+#define NRX2(ch) (NR10 + 5 * (ch) + 2)
+#define NRX3(ch) (NR10 + 5 * (ch) + 3)
+#define NRX4(ch) (NR10 + 5 * (ch) + 4)
+
+static const __uint8_t duty_patterns[4] = {0x01, 0x81, 0x87, 0x7E}; // one bit per step
+static const __uint8_t noise_divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+static const __uint8_t wave_shifts[4] = {4, 0, 1, 2};
+
+// Bits that read back as 1, 0xFF10-0xFF2F
+static const __uint8_t read_masks[0x20] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF, 0x9F, 0xFF, 0xBF, 0xFF,
+    0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00, 0x70, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static bool synthesizing(CPU *cpu)
+{
+    return cpu->audio != NULL || cpu->capture != NULL;
+}
+
+static bool powered(CPU *cpu)
+{
+    return cpu->memory[NR52] & 0x80;
+}
+
+static __uint16_t frequency(CPU *cpu, int ch)
+{
+    return cpu->memory[NRX3(ch)] | (cpu->memory[NRX4(ch)] & 0x07) << 8;
+}
+
+static void update_period(CPU *cpu, int ch)
+{
+    Channel *c = &cpu->apu.channels[ch];
+
+    switch (ch)
+    {
+    case 0:
+    case 1:
+        c->period = (2048 - frequency(cpu, ch)) * 4;
+        break;
+    case 2:
+        c->period = (2048 - frequency(cpu, ch)) * 2;
+        break;
+    default:
+    {
+        __uint8_t nr43 = cpu->memory[NR43];
+        c->period = noise_divisors[nr43 & 0x07] << (nr43 >> 4);
+        break;
+    }
+    }
+}
+
+// True when stepping the channel can't change its level, so update_apu
+// only has to advance its position
+static bool silent(CPU *cpu, int ch)
+{
+    Channel *c = &cpu->apu.channels[ch];
+
+    if (!c->dac)
+        return true;
+    if (ch == 2)
+        return (cpu->memory[NR32] & 0x60) == 0;
+    return c->volume == 0;
+}
+
+static void update_output(CPU *cpu, int ch)
+{
+    Channel *c = &cpu->apu.channels[ch];
+    __uint8_t level = 0;
+
+    if (c->enabled && c->dac)
+    {
+        switch (ch)
+        {
+        case 0:
+        case 1:
+            if (duty_patterns[cpu->memory[NRX1(ch)] >> 6] >> c->position & 1)
+                level = c->volume;
+            break;
+        case 2:
+        {
+            __uint8_t sample = cpu->memory[WAVE_RAM + c->position / 2];
+            sample = c->position & 1 ? sample & 0x0F : sample >> 4;
+            level = sample >> wave_shifts[(cpu->memory[NR32] >> 5) & 0x03];
+            break;
+        }
+        default:
+            if (!(c->lfsr & 1))
+                level = c->volume;
+            break;
+        }
+    }
+    c->output = level;
+}
+
+// Hands the samples synthesized so far to the audio sink
+static void end_frame(CPU *cpu)
+{
+    APU *apu = &cpu->apu;
+    __int16_t samples[BLIP_MAX_SAMPLES * 2];
+
+    blip_end_frame(&apu->blip_left, apu->clock);
+    blip_end_frame(&apu->blip_right, apu->clock);
+    apu->clock = 0;
+
+    int count = blip_samples_avail(&apu->blip_left);
+    blip_read_samples(&apu->blip_left, samples, count, 2);
+    blip_read_samples(&apu->blip_right, samples + 1, count, 2);
+    if (cpu->capture)
+        capture_push(cpu->capture, samples, count);
+    if (cpu->audio)
+    {
+        audio_push(cpu->audio, samples, count);
+
+        // A captured stream has to be reproducible, so it keeps the nominal rate
+        if (cpu->capture == NULL)
+        {
+            double rate = audio_sample_rate(cpu->audio);
+            blip_set_rates(&apu->blip_left, APU_CLOCK_RATE, rate);
+            blip_set_rates(&apu->blip_right, APU_CLOCK_RATE, rate);
+        }
+    }
+}
+
+// Feeds the change in the channel's left/right contribution since the last
+// call to the synthesizer, at time T-cycles into the current frame
+static void mix(CPU *cpu, int ch, __uint32_t time)
+{
+    APU *apu = &cpu->apu;
+    Channel *c = &apu->channels[ch];
+    __uint8_t nr50 = cpu->memory[NR50];
+    __uint8_t nr51 = cpu->memory[NR51];
+    __int32_t left = 0;
+    __int32_t right = 0;
+
+    if (nr51 & (0x10 << ch))
+        left = c->output * (((nr50 >> 4) & 0x07) + 1) * APU_VOLUME_SCALE;
+    if (nr51 & (0x01 << ch))
+        right = c->output * ((nr50 & 0x07) + 1) * APU_VOLUME_SCALE;
+
+    if (left != c->left)
+    {
+        blip_add_delta(&apu->blip_left, time, left - c->left);
+        c->left = left;
+    }
+    if (right != c->right)
+    {
+        blip_add_delta(&apu->blip_right, time, right - c->right);
+        c->right = right;
+    }
+}
+
+// Advances the noise LFSR by steps clocks
+static void clock_lfsr(CPU *cpu, Channel *c, __int32_t steps)
+{
+    bool short_mode = cpu->memory[NR43] & 0x08;
+
+    while (steps--)
+    {
+        __uint16_t bit = (c->lfsr ^ (c->lfsr >> 1)) & 1;
+        c->lfsr = (c->lfsr >> 1) | (bit << 14);
+        if (short_mode)
+            c->lfsr = (c->lfsr & ~0x40) | (bit << 6);
+    }
+}
+
+// Runs the channel's waveform for cycles T-cycles from the start of the
+// pending span, handing every level change to the synthesizer
+static void run_channel(CPU *cpu, int ch, __int32_t cycles)
+{
+    APU *apu = &cpu->apu;
+    Channel *c = &apu->channels[ch];
+    __uint8_t mask = ch == 2 ? 31 : 7;
+
+    if (!c->enabled)
+        return;
+    if (c->timer > cycles)
+    {
+        c->timer -= cycles;
+        return;
+    }
+    if (c->output == 0 && silent(cpu, ch))
+    {
+        // Nothing to hear, only keep the waveform in phase
+        __int32_t steps = 1 + (cycles - c->timer) / c->period;
+        c->timer += steps * c->period - cycles;
+        if (ch == 3)
+            clock_lfsr(cpu, c, steps);
+        else
+            c->position = (c->position + steps) & mask;
+        return;
+    }
+
+    __int32_t time = c->timer;
+    do
+    {
+        if (ch == 3)
+            clock_lfsr(cpu, c, 1);
+        else
+            c->position = (c->position + 1) & mask;
+        __uint8_t previous = c->output;
+        update_output(cpu, ch);
+        if (c->output != previous)
+            mix(cpu, ch, apu->clock + time);
+        time += c->period;
+    } while (time <= cycles);
+    c->timer = time - cycles;
+}
+
+// Picks the next point update_apu has to catch up at: the earliest audible
+// waveform step or the end of the frame
+static void schedule(CPU *cpu)
+{
+    APU *apu = &cpu->apu;
+
+    apu->next_event = APU_FRAME_CYCLES - apu->clock;
+    if (!powered(cpu))
+        return;
+    for (int ch = 0; ch < 4; ch++)
+    {
+        Channel *c = &apu->channels[ch];
+        if (c->enabled && !(c->output == 0 && silent(cpu, ch)) && (__uint32_t)c->timer < apu->next_event)
+            apu->next_event = c->timer;
+    }
+}
+
+// Brings the channels and the synthesizer up to the current T-cycle
+static void catch_up(CPU *cpu)
+{
+    APU *apu = &cpu->apu;
+    __int32_t cycles = apu->pending;
+
+    if (!synthesizing(cpu))
+        return;
+    apu->pending = 0;
+    if (powered(cpu))
+    {
+        for (int ch = 0; ch < 4; ch++)
+            run_channel(cpu, ch, cycles);
+    }
+    apu->clock += cycles;
+    if (apu->clock >= APU_FRAME_CYCLES)
+        end_frame(cpu);
+    schedule(cpu);
+}
+
+// Refreshes every channel's level after a register or sequencer change,
+// once catch_up has brought the channels to the current T-cycle
+static void update_all(CPU *cpu)
+{
+    if (!synthesizing(cpu))
+        return;
+    for (int ch = 0; ch < 4; ch++)
+    {
+        update_output(cpu, ch);
+        mix(cpu, ch, cpu->apu.clock);
+    }
+    schedule(cpu);
+}
+
+static __uint16_t sweep_calculate(CPU *cpu)
+{
+    Channel *c = &cpu->apu.channels[0];
+    __uint8_t nr10 = cpu->memory[NR10];
+    __uint16_t delta = c->shadow >> (nr10 & 0x07);
+    __uint16_t next = nr10 & 0x08 ? c->shadow - delta : c->shadow + delta;
+
+    if (next > 2047)
+        c->enabled = false;
+    return next;
+}
+
+static void clock_sweep(CPU *cpu)
+{
+    Channel *c = &cpu->apu.channels[0];
+    __uint8_t nr10 = cpu->memory[NR10];
+    __uint8_t sweep_period = (nr10 >> 4) & 0x07;
+
+    if (--c->sweep_timer > 0)
+        return;
+    c->sweep_timer = sweep_period ? sweep_period : 8;
+    if (!c->sweep_enabled || sweep_period == 0)
+        return;
+
+    __uint16_t next = sweep_calculate(cpu);
+    if (next <= 2047 && (nr10 & 0x07))
+    {
+        c->shadow = next;
+        cpu->memory[NR13] = next & 0xFF;
+        cpu->memory[NR14] = (cpu->memory[NR14] & ~0x07) | (next >> 8);
+        update_period(cpu, 0);
+        sweep_calculate(cpu);
+    }
+}
+
+static void clock_envelope(CPU *cpu, int ch)
+{
+    Channel *c = &cpu->apu.channels[ch];
+    __uint8_t nrx2 = cpu->memory[NRX2(ch)];
+
+    if ((nrx2 & 0x07) == 0)
+        return;
+    if (c->envelope_timer)
+        c->envelope_timer--;
+    if (c->envelope_timer)
+        return;
+    c->envelope_timer = nrx2 & 0x07;
+    if (nrx2 & 0x08 && c->volume < 15)
+        c->volume++;
+    else if (!(nrx2 & 0x08) && c->volume > 0)
+        c->volume--;
+}
+
+static void clock_sequencer(CPU *cpu)
+{
+    APU *apu = &cpu->apu;
+    __uint8_t step = apu->sequencer_step;
+
+    if (!powered(cpu))
+        return;
+    catch_up(cpu);
+    if (!(step & 1))
+    {
+        for (int ch = 0; ch < 4; ch++)
+        {
+            Channel *c = &apu->channels[ch];
+            if (c->length_enabled && c->length && --c->length == 0)
+                c->enabled = false;
+        }
+    }
+    if (step == 2 || step == 6)
+        clock_sweep(cpu);
+    if (step == 7)
+    {
+        clock_envelope(cpu, 0);
+        clock_envelope(cpu, 1);
+        clock_envelope(cpu, 3);
+    }
+    apu->sequencer_step = (step + 1) & 7;
+    update_all(cpu);
+}
+
+static void trigger(CPU *cpu, int ch)
+{
+    Channel *c = &cpu->apu.channels[ch];
+
+    c->enabled = c->dac;
+    if (c->length == 0)
+        c->length = ch == 2 ? 256 : 64;
+    c->timer = c->period;
+    if (ch != 2)
+    {
+        c->volume = cpu->memory[NRX2(ch)] >> 4;
+        c->envelope_timer = cpu->memory[NRX2(ch)] & 0x07;
+    }
+    if (ch == 2)
+        c->position = 0;
+    if (ch == 3)
+        c->lfsr = 0x7FFF;
+    if (ch == 0)
+    {
+        __uint8_t nr10 = cpu->memory[NR10];
+        __uint8_t sweep_period = (nr10 >> 4) & 0x07;
+        c->shadow = frequency(cpu, 0);
+        c->sweep_timer = sweep_period ? sweep_period : 8;
+        c->sweep_enabled = sweep_period || (nr10 & 0x07);
+        if (nr10 & 0x07)
+            sweep_calculate(cpu);
+    }
+}
+
+void apu_init(CPU *cpu)
+{
+    APU *apu = &cpu->apu;
+
+    blip_init(&apu->blip_left);
+    blip_init(&apu->blip_right);
+    blip_set_rates(&apu->blip_left, APU_CLOCK_RATE, APU_SAMPLE_RATE);
+    blip_set_rates(&apu->blip_right, APU_CLOCK_RATE, APU_SAMPLE_RATE);
+
+    // State left behind by the boot ROM
+    static const __uint8_t registers[0x17] = {
+        0x80, 0xBF, 0xF3, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF,
+        0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x77, 0xF3, 0xF1};
+    memcpy(&cpu->memory[NR10], registers, sizeof(registers));
+    for (int ch = 0; ch < 4; ch++)
+        update_period(cpu, ch);
+    apu->channels[0].dac = true;
+    apu->channels[0].enabled = true;
+    apu->channels[0].timer = apu->channels[0].period;
+    apu->channels[3].lfsr = 0x7FFF;
+}
+
+void update_apu(CPU *cpu, __uint8_t t_cycles)
+{
+    APU *apu = &cpu->apu;
+    bool div_bit = cpu->div_cycles & 0x1000;
+
+    if (synthesizing(cpu))
+        apu->pending += t_cycles;
+    if (apu->div_bit && !div_bit)
+        clock_sequencer(cpu);
+    apu->div_bit = div_bit;
+
+    if (synthesizing(cpu) && apu->pending >= apu->next_event)
+        catch_up(cpu);
+}
+
+__uint8_t apu_read(CPU *cpu, __uint16_t address)
+{
+    if (address == NR52)
+    {
+        __uint8_t status = cpu->memory[NR52] & 0x80;
+        for (int ch = 0; ch < 4; ch++)
+        {
+            if (cpu->apu.channels[ch].enabled)
+                status |= 1 << ch;
+        }
+        return status | read_masks[NR52 - NR10];
+    }
+    if (address < WAVE_RAM)
+        return cpu->memory[address] | read_masks[address - NR10];
+    return cpu->memory[address];
+}
+
+void apu_write(CPU *cpu, __uint16_t address, __uint8_t value)
+{
+    APU *apu = &cpu->apu;
+
+    catch_up(cpu);
+    if (address == NR52)
+    {
+        if (!(value & 0x80) && powered(cpu))
+        {
+            memset(&cpu->memory[NR10], 0, NR52 - NR10);
+            for (int ch = 0; ch < 4; ch++)
+            {
+                apu->channels[ch].enabled = false;
+                apu->channels[ch].dac = false;
+                update_period(cpu, ch);
+            }
+        }
+        else if (value & 0x80 && !powered(cpu))
+            apu->sequencer_step = 0;
+        cpu->memory[NR52] = value & 0x80;
+        update_all(cpu);
+        return;
+    }
+    if (address < WAVE_RAM && !powered(cpu))
+        return; // read-only while powered off
+    cpu->memory[address] = value;
+
+    switch (address)
+    {
+    case NR11:
+    case NR21:
+    case NR41:
+        apu->channels[(address - NR10) / 5].length = 64 - (value & 0x3F);
+        break;
+    case NR31:
+        apu->channels[2].length = 256 - value;
+        break;
+    case NR12:
+    case NR22:
+    case NR42:
+    {
+        Channel *c = &apu->channels[(address - NR10) / 5];
+        c->dac = value & 0xF8;
+        if (!c->dac)
+            c->enabled = false;
+        break;
+    }
+    case NR30:
+        apu->channels[2].dac = value & 0x80;
+        if (!apu->channels[2].dac)
+            apu->channels[2].enabled = false;
+        break;
+    case NR13:
+    case NR23:
+    case NR33:
+        update_period(cpu, (address - NR10) / 5);
+        break;
+    case NR43:
+        update_period(cpu, 3);
+        break;
+    case NR14:
+    case NR24:
+    case NR34:
+    case NR44:
+    {
+        int ch = (address - NR10) / 5;
+        update_period(cpu, ch);
+        apu->channels[ch].length_enabled = value & 0x40;
+        if (value & 0x80)
+            trigger(cpu, ch);
+        break;
+    }
+    }
+    update_all(cpu);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include "blip.h"
+#define NR10 0xFF10
+#define NR11 0xFF11
+#define NR12 0xFF12
+#define NR13 0xFF13
+#define NR14 0xFF14
+#define NR21 0xFF16
+#define NR22 0xFF17
+#define NR23 0xFF18
+#define NR24 0xFF19
+#define NR30 0xFF1A
+#define NR31 0xFF1B
+#define NR32 0xFF1C
+#define NR33 0xFF1D
+#define NR34 0xFF1E
+#define NR41 0xFF20
+#define NR42 0xFF21
+#define NR43 0xFF22
+#define NR44 0xFF23
+#define NR50 0xFF24
+#define NR51 0xFF25
+#define NR52 0xFF26
+#define WAVE_RAM 0xFF30
+#define APU_CLOCK_RATE 4194304
+#define APU_SAMPLE_RATE 48000
+#define APU_VOLUME_SCALE 64 // 4 channels * 15 * 8 (NR50) * 64 stays inside 16 bits
+
+typedef struct CPU CPU;
+
+typedef struct Channel
+{
+    bool enabled;
+    bool dac;
+    __uint16_t length;   // remaining length steps
+    bool length_enabled;
+    __int32_t period;    // T-cycles per waveform step, cached from the registers
+    __int32_t timer;     // T-cycles to the next waveform step
+    __uint8_t position;  // duty step, wave sample or unused (noise)
+    __uint8_t volume;
+    __uint8_t envelope_timer;
+    __uint16_t lfsr;     // noise
+    __uint16_t shadow;   // sweep
+    __uint8_t sweep_timer;
+    bool sweep_enabled;
+    __uint8_t output;    // current digital level, 0-15
+    __int32_t left;      // contribution last handed to each synthesizer
+    __int32_t right;
+} Channel;
+
+typedef struct APU
+{
+    Channel channels[4];
+    __uint8_t sequencer_step;
+    bool div_bit; // DIV bit 4, the frame sequencer clocks on its falling edge
+    __uint32_t clock; // T-cycles since the last blip_end_frame, up to the last catch-up
+    __uint32_t pending; // T-cycles elapsed since the last catch-up
+    __uint32_t next_event; // pending T-cycles at which the channels need running
+    Blip blip_left;
+    Blip blip_right;
+} APU;
+
+void apu_init(CPU *cpu);
+void update_apu(CPU *cpu, __uint8_t t_cycles);
+__uint8_t apu_read(CPU *cpu, __uint16_t address);
+void apu_write(CPU *cpu, __uint16_t address, __uint8_t value);
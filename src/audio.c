@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio.h"
+#include "apu.h"
+
+static void audio_callback(void *userdata, Uint8 *stream, int length)
+{
+    Audio *audio = userdata;
+    __int16_t *out = (__int16_t *)stream;
+    __uint32_t wanted = length / (2 * sizeof(__int16_t));
+    __uint32_t tail = audio->tail;
+    __uint32_t available = __atomic_load_n(&audio->head, __ATOMIC_ACQUIRE) - tail;
+    __uint32_t count = available < wanted ? available : wanted;
+
+    for (__uint32_t i = 0; i < count; i++)
+    {
+        __uint32_t index = (tail + i) & (AUDIO_RING_FRAMES - 1);
+        out[2 * i] = audio->ring[2 * index];
+        out[2 * i + 1] = audio->ring[2 * index + 1];
+    }
+    memset(out + 2 * count, 0, (wanted - count) * 2 * sizeof(__int16_t));
+    if (count < wanted)
+    {
+        audio->underruns++;
+        audio->underrun_frames += wanted - count;
+    }
+    __atomic_store_n(&audio->tail, tail + count, __ATOMIC_RELEASE);
+}
+
+// NULL when there's no audio device; the APU then skips synthesis.
+// The device starts paused and is unpaused by audio_push once the ring
+// holds AUDIO_LATENCY_FRAMES, so it doesn't underrun right away.
+Audio *audio_init(bool sync)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+    {
+        printf("SDL audio could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    Audio *audio = calloc(1, sizeof(Audio));
+    audio->sync = sync;
+    SDL_AudioSpec want = {0};
+    want.freq = APU_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = AUDIO_DEVICE_FRAMES;
+    want.callback = audio_callback;
+    want.userdata = audio;
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (audio->device == 0)
+    {
+        printf("Audio device could not be opened! SDL_Error: %s\n", SDL_GetError());
+        free(audio);
+        return NULL;
+    }
+    return audio;
+}
+
+void audio_free(Audio *audio)
+{
+    if (audio == NULL)
+        return;
+    SDL_CloseAudioDevice(audio->device);
+    free(audio);
+}
+
+void audio_push(Audio *audio, const __int16_t *frames, int count)
+{
+    __uint32_t head = audio->head;
+    __uint32_t space = AUDIO_RING_FRAMES - (head - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE));
+
+    if ((__uint32_t)count > space)
+    {
+        audio->dropped_frames += count - space;
+        count = space;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        __uint32_t index = (head + i) & (AUDIO_RING_FRAMES - 1);
+        audio->ring[2 * index] = frames[2 * i];
+        audio->ring[2 * index + 1] = frames[2 * i + 1];
+    }
+    __atomic_store_n(&audio->head, head + count, __ATOMIC_RELEASE);
+
+    __uint32_t fill = head + count - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE);
+    if (!audio->started && fill >= AUDIO_LATENCY_FRAMES)
+    {
+        audio->started = true;
+        SDL_PauseAudioDevice(audio->device, 0);
+    }
+    // Sleep off whatever is queued beyond the target, the device drains
+    // it at exactly its own sample rate
+    while (audio->sync && audio->started && fill > AUDIO_LATENCY_FRAMES)
+    {
+        __int64_t ns = (__int64_t)(fill - AUDIO_LATENCY_FRAMES) * 1000000000 / APU_SAMPLE_RATE;
+        struct timespec wait = {ns / 1000000000, ns % 1000000000};
+        nanosleep(&wait, NULL);
+        fill = head + count - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE);
+    }
+    audio->fill_sum += fill;
+    audio->pushes++;
+}
+
+// Output rate for the synthesizer. When a Pacer keeps wall time the host
+// and the audio device clocks drift apart, so the rate is nudged by a
+// fraction of a percent to steer the ring back to AUDIO_LATENCY_FRAMES:
+// fewer samples per emulated second while it's fuller, more while it's
+// emptier. The pitch change is inaudible. Under --audio-sync the device
+// is the clock and the rate stays nominal.
+double audio_sample_rate(Audio *audio)
+{
+    if (audio->sync || !audio->started)
+        return APU_SAMPLE_RATE;
+
+    __int32_t fill = audio->head - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE);
+    double error = (double)(AUDIO_LATENCY_FRAMES - fill) / AUDIO_LATENCY_FRAMES;
+    if (error > 1)
+        error = 1;
+    else if (error < -1)
+        error = -1;
+    return APU_SAMPLE_RATE * (1 + error * AUDIO_MAX_RATE_DELTA);
+}
+
+void audio_report(Audio *audio, FILE *out)
+{
+    double fill_ms = audio->pushes ? (double)audio->fill_sum / audio->pushes * 1000 / APU_SAMPLE_RATE : 0;
+    double device_ms = (double)AUDIO_DEVICE_FRAMES * 1000 / APU_SAMPLE_RATE;
+
+    fprintf(out, "Audio: %.1f ms latency on average (%.1f ms queued + %.1f ms device buffer), %s\n",
+            fill_ms + device_ms, fill_ms, device_ms, audio->sync ? "paced by the device" : "rate controlled");
+    fprintf(out, "Audio: %lu underruns (%lu frames of silence), %lu frames dropped on a full queue\n",
+            audio->underruns, audio->underrun_frames, audio->dropped_frames);
+}
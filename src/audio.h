@@ -0,0 +1,31 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#define AUDIO_RING_FRAMES 8192 // stereo frames, power of two
+#define AUDIO_DEVICE_FRAMES 512
+#define AUDIO_LATENCY_FRAMES 1024 // ring fill to hold, ~21 ms at 48 kHz plus the device buffer
+#define AUDIO_MAX_RATE_DELTA 0.005 // rate control moves the output rate by at most 0.5%
+
+// Sample queue from the APU (emulation thread) to the SDL audio callback.
+// Single producer, single consumer, no locks.
+typedef struct Audio
+{
+    SDL_AudioDeviceID device;
+    bool sync;    // audio_push waits on the device, which then paces emulation
+    bool started; // device unpaused, once the ring first filled to AUDIO_LATENCY_FRAMES
+    __int16_t ring[AUDIO_RING_FRAMES * 2];
+    __uint32_t head; // written by the emulation thread
+    __uint32_t tail; // written by the audio callback
+    __uint64_t dropped_frames; // ring was full
+    __uint64_t underruns;      // callbacks that ran out of samples after the start
+    __uint64_t underrun_frames;
+    __uint64_t fill_sum;       // ring fill after every push, for the latency report
+    __uint64_t pushes;
+} Audio;
+
+Audio *audio_init(bool sync);
+void audio_free(Audio *audio);
+void audio_push(Audio *audio, const __int16_t *frames, int count);
+double audio_sample_rate(Audio *audio);
+void audio_report(Audio *audio, FILE *out);
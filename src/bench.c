@@ -0,0 +1,78 @@
+#include <time.h>
+#include "bench.h"
+#include "state.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_run(CPU *cpu, __uint64_t frames, BenchResult *result)
+{
+    __uint64_t start_cycles = cpu->cycles;
+    __uint64_t start_frames = cpu->frames;
+    __uint64_t ticks[SECTION_COUNT];
+    __uint64_t total = 0;
+    __uint64_t overhead;
+
+    cpu->frame_limit = cpu->frames + frames;
+    sections_reset();
+    double start = now();
+    CPU_start(cpu, NULL);
+    result->seconds = now() - start;
+    sections_read(ticks, &overhead);
+
+    result->frame_hash = state_frame_hash(cpu);
+    result->frames = cpu->frames - start_frames;
+    result->cycles = cpu->cycles - start_cycles;
+    result->sections = sections_enabled();
+    for (int i = 0; i < SECTION_COUNT; i++)
+        total += ticks[i];
+    for (int i = 0; i < SECTION_COUNT; i++)
+        result->shares[i] = total ? (double)ticks[i] / total : 0;
+    result->charge_overhead = sections_charge_overhead();
+    result->overhead_share = total + overhead ? (double)overhead / (total + overhead) : 0;
+}
+
+void bench_write_json(BenchResult *result, FILE *out)
+{
+    double emulated = result->cycles / 4194304.0;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"rom\": \"");
+    for (const char *c = result->rom; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fprintf(out, "\",\n");
+    fprintf(out, "  \"engine\": \"%s\",\n", result->engine);
+    fprintf(out, "  \"frames\": %lu,\n", result->frames);
+    fprintf(out, "  \"cycles\": %lu,\n", result->cycles);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", result->seconds);
+    fprintf(out, "  \"emulated_mhz\": %.3f,\n", result->cycles / result->seconds / 1e6);
+    fprintf(out, "  \"fps\": %.2f,\n", result->frames / result->seconds);
+    fprintf(out, "  \"speed\": %.3f,\n", emulated / result->seconds); // times real time
+    fprintf(out, "  \"frame_hash\": \"%016lx\",\n", result->frame_hash);
+    if (result->sections)
+    {
+        // The hooks' cost comes off every charge, but hooks in the emulator
+        // cost a bit more than measured back to back, so small, frequent
+        // sections (memory, apu) still read somewhat high
+        fprintf(out, "  \"section_overhead\": {\"ticks_per_charge\": %lu, \"share_removed\": %.4f},\n",
+                result->charge_overhead, result->overhead_share);
+        fprintf(out, "  \"sections\": {");
+        for (int i = 0; i < SECTION_COUNT; i++)
+            fprintf(out, "%s\"%s\": %.4f", i ? ", " : "", section_names[i], result->shares[i]);
+        fprintf(out, "}\n");
+    }
+    else
+    {
+        fprintf(out, "  \"section_overhead\": null,\n");
+        fprintf(out, "  \"sections\": null\n");
+    }
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "sections.h"
+#define BENCH_DEFAULT_FRAMES 3600 // one emulated minute
+
+typedef struct BenchResult
+{
+    const char *rom;
+    const char *engine;
+    __uint64_t frames;
+    __uint64_t cycles;
+    double seconds;
+    __uint64_t frame_hash; // the last frame, to check runs emulated the same thing
+    bool sections; // shares are only measured by SECTIONS builds
+    double shares[SECTION_COUNT];
+    __uint64_t charge_overhead; // TSC ticks taken off the sections per charge
+    double overhead_share;      // of all ticks measured, taken off as hook cost
+} BenchResult;
+
+// Runs frames frames from the CPU's current state without SDL, as fast as
+// possible, and times them. The CPU should have no display, audio or pacer.
+void bench_run(CPU *cpu, __uint64_t frames, BenchResult *result);
+void bench_write_json(BenchResult *result, FILE *out);
@@ -0,0 +1,138 @@
+#include <math.h>
+#include <string.h>
+#include "blip.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIP_AVX2
+#endif
+
+// kernel[phase][i]: band-limited impulse for a step that happens phase /
+// BLIP_PHASES of a sample after the start of tap 0's sample, normalised so
+// every phase sums to exactly 1 << BLIP_KERNEL_BITS (no DC error when the
+// deltas are integrated back).
+static __int32_t kernel[BLIP_PHASES][BLIP_TAPS];
+static int kernel_ready;
+
+// Adds delta times one kernel phase to BLIP_TAPS output samples. Every
+// level change of every channel goes through here, so it's the hot loop
+// of sound synthesis. Both versions give bit-identical results.
+static void add_kernel_scalar(__int32_t *out, const __int32_t *k, __int32_t delta)
+{
+    for (int i = 0; i < BLIP_TAPS; i++)
+        out[i] += k[i] * delta;
+}
+
+#ifdef BLIP_AVX2
+__attribute__((target("avx2"))) static void add_kernel_avx2(__int32_t *out, const __int32_t *k, __int32_t delta)
+{
+    __m256i d = _mm256_set1_epi32(delta);
+
+    for (int i = 0; i < BLIP_TAPS; i += 8)
+    {
+        __m256i taps = _mm256_loadu_si256((const __m256i *)&k[i]);
+        __m256i samples = _mm256_loadu_si256((const __m256i *)&out[i]);
+        samples = _mm256_add_epi32(samples, _mm256_mullo_epi32(taps, d));
+        _mm256_storeu_si256((__m256i *)&out[i], samples);
+    }
+}
+#endif
+
+static void (*add_kernel)(__int32_t *out, const __int32_t *k, __int32_t delta) = add_kernel_scalar;
+
+static void init_kernel(void)
+{
+    const double cutoff = 0.9; // of the output Nyquist frequency
+
+    for (int phase = 0; phase < BLIP_PHASES; phase++)
+    {
+        double taps[BLIP_TAPS];
+        double sum = 0;
+        for (int i = 0; i < BLIP_TAPS; i++)
+        {
+            double x = i - (BLIP_TAPS / 2 - 1) - (double)phase / BLIP_PHASES;
+            double sinc = x == 0 ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = 0.5 + 0.5 * cos(M_PI * x / (BLIP_TAPS / 2));
+            taps[i] = fabs(x) < BLIP_TAPS / 2 ? sinc * window : 0;
+            sum += taps[i];
+        }
+
+        __int32_t total = 0;
+        for (int i = 0; i < BLIP_TAPS; i++)
+        {
+            kernel[phase][i] = lround(taps[i] / sum * (1 << BLIP_KERNEL_BITS));
+            total += kernel[phase][i];
+        }
+        kernel[phase][BLIP_TAPS / 2 - 1] += (1 << BLIP_KERNEL_BITS) - total;
+    }
+    kernel_ready = 1;
+    blip_simd(true);
+}
+
+bool blip_simd(bool enable)
+{
+    add_kernel = add_kernel_scalar;
+#ifdef BLIP_AVX2
+    if (enable && __builtin_cpu_supports("avx2"))
+        add_kernel = add_kernel_avx2;
+#endif
+    return add_kernel != add_kernel_scalar;
+}
+
+void blip_init(Blip *blip)
+{
+    if (!kernel_ready)
+        init_kernel();
+    memset(blip, 0, sizeof(Blip));
+}
+
+void blip_set_rates(Blip *blip, double clock_rate, double sample_rate)
+{
+    blip->factor = (__uint64_t)(sample_rate / clock_rate * 4294967296.0);
+}
+
+void blip_add_delta(Blip *blip, __uint32_t time, __int32_t delta)
+{
+    __uint64_t position = blip->offset + time * blip->factor;
+    __uint32_t index = position >> 32;
+    __uint32_t phase = (position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+
+    if (index >= BLIP_MAX_SAMPLES)
+        return; // frame too long for the buffer, drop rather than overrun
+    add_kernel(&blip->buffer[index], kernel[phase], delta);
+}
+
+void blip_end_frame(Blip *blip, __uint32_t clocks)
+{
+    blip->offset += clocks * blip->factor;
+}
+
+int blip_samples_avail(Blip *blip)
+{
+    int avail = blip->offset >> 32;
+    return avail < BLIP_MAX_SAMPLES ? avail : BLIP_MAX_SAMPLES;
+}
+
+void blip_read_samples(Blip *blip, __int16_t *out, int count, int stride)
+{
+    __int32_t integrator = blip->integrator;
+
+    for (int i = 0; i < count; i++)
+    {
+        integrator += blip->buffer[i];
+        __int32_t sample = integrator >> BLIP_KERNEL_BITS;
+        if (sample > 32767)
+            sample = 32767;
+        if (sample < -32768)
+            sample = -32768;
+        out[i * stride] = sample;
+        integrator -= sample << (BLIP_KERNEL_BITS - BLIP_BASS_SHIFT);
+    }
+    blip->integrator = integrator;
+
+    int remaining = (blip->offset >> 32) - count;
+    if (remaining < 0)
+        remaining = 0;
+    memmove(blip->buffer, &blip->buffer[count], (remaining + BLIP_TAPS) * sizeof(__int32_t));
+    memset(&blip->buffer[remaining + BLIP_TAPS], 0, (BLIP_MAX_SAMPLES - remaining) * sizeof(__int32_t));
+    blip->offset -= (__uint64_t)count << 32;
+}
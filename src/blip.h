@@ -0,0 +1,33 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_TAPS 16
+#define BLIP_KERNEL_BITS 14
+#define BLIP_BASS_SHIFT 9    // DC-blocking high-pass, about 15 Hz at 48 kHz
+#define BLIP_MAX_SAMPLES 512 // per frame, before blip_read_samples
+
+// Band-limited synthesis of a square-ish signal. The APU reports each
+// change of output level as a delta at the T-cycle it happened; the delta
+// is spread over BLIP_TAPS output samples with a windowed-sinc step kernel
+// at the right sub-sample phase, and reading integrates the deltas back
+// into samples. Only level changes cost anything, not input clocks.
+typedef struct Blip
+{
+    __uint64_t factor; // output samples per input clock, 32.32 fixed point
+    __uint64_t offset; // fractional position of clock 0 of the current frame
+    __int32_t integrator;
+    __int32_t buffer[BLIP_MAX_SAMPLES + BLIP_TAPS];
+} Blip;
+
+void blip_init(Blip *blip);
+// Uses the AVX2 kernel when enable is set and the CPU has it (the default),
+// returns whether it's in use
+bool blip_simd(bool enable);
+void blip_set_rates(Blip *blip, double clock_rate, double sample_rate);
+void blip_add_delta(Blip *blip, __uint32_t time, __int32_t delta);
+void blip_end_frame(Blip *blip, __uint32_t clocks);
+int blip_samples_avail(Blip *blip);
+// Writes count samples to out (every stride-th element) and drops them
+void blip_read_samples(Blip *blip, __int16_t *out, int count, int stride);
@@ -0,0 +1,133 @@
+#include <string.h>
+#include "callstack.h"
+#include "memory.h"
+
+// A shadow of the guest stack, updated by CALL/RST/interrupt dispatch and
+// RET/RETI. Elapsed T-cycles are charged to the current call path at
+// every transition. Frames remember the SP of their return address, so
+// code that drops a return address (POP then JP) is resynced on the next
+// RET instead of leaving the shadow stack deeper than the real one.
+
+static CallNode *current(CallStack *callstack)
+{
+    return callstack->depth ? callstack->frames[callstack->depth - 1].node : &callstack->root;
+}
+
+// Loading an older state (rollback, run-ahead) moves cpu->cycles back. The
+// span across the load isn't charged rather than wrapping around.
+static void charge(CallStack *callstack, CPU *cpu)
+{
+    if (cpu->cycles > callstack->last_cycles)
+        current(callstack)->cycles += cpu->cycles - callstack->last_cycles;
+    callstack->last_cycles = cpu->cycles;
+}
+
+CallStack *callstack_init(CPU *cpu)
+{
+    CallStack *callstack = calloc(1, sizeof(CallStack));
+    callstack->last_cycles = cpu->cycles;
+    return callstack;
+}
+
+static void free_nodes(CallNode *node)
+{
+    while (node)
+    {
+        CallNode *sibling = node->sibling;
+        free_nodes(node->child);
+        free(node);
+        node = sibling;
+    }
+}
+
+void callstack_free(CallStack *callstack)
+{
+    if (callstack == NULL)
+        return;
+    free_nodes(callstack->root.child);
+    free(callstack);
+}
+
+// Called once PC holds the callee and the return address is pushed
+void callstack_call(CPU *cpu, bool interrupt)
+{
+    CallStack *callstack = cpu->callstack;
+    charge(callstack, cpu);
+    if (callstack->depth == CALLSTACK_MAX_DEPTH)
+    {
+        callstack->dropped_calls++;
+        return;
+    }
+
+    CallNode *parent = current(callstack);
+    __uint8_t bank = rom_bank_at(cpu->cartridge, cpu->PC);
+    CallNode *node = parent->child;
+    while (node && (node->address != cpu->PC || node->bank != bank || node->interrupt != interrupt))
+        node = node->sibling;
+    if (node == NULL)
+    {
+        node = calloc(1, sizeof(CallNode));
+        node->bank = bank;
+        node->address = cpu->PC;
+        node->interrupt = interrupt;
+        node->parent = parent;
+        node->sibling = parent->child;
+        parent->child = node;
+    }
+    node->calls++;
+    callstack->frames[callstack->depth++] = (CallFrame){node, cpu->SP};
+}
+
+// Called before the return address is popped
+void callstack_return(CPU *cpu)
+{
+    CallStack *callstack = cpu->callstack;
+    charge(callstack, cpu);
+
+    while (callstack->depth && callstack->frames[callstack->depth - 1].sp < cpu->SP)
+        callstack->depth--;
+    if (callstack->depth && callstack->frames[callstack->depth - 1].sp == cpu->SP)
+        callstack->depth--;
+    else
+        callstack->unmatched_returns++;
+}
+
+static int frame_name(CallNode *node, Symbols *symbols, char *out, size_t size)
+{
+    const Symbol *symbol = symbols_lookup(symbols, node->bank, node->address);
+    const char *prefix = node->interrupt ? "irq " : "";
+
+    if (symbol && symbol->address == node->address)
+        return snprintf(out, size, "%s%s", prefix, symbol->name);
+    if (symbol)
+        return snprintf(out, size, "%s%s+%u", prefix, symbol->name, node->address - symbol->address);
+    return snprintf(out, size, "%s%02X:%04X", prefix, node->bank, node->address);
+}
+
+static void write_folded(CallNode *node, Symbols *symbols, FILE *folded, char *path, size_t length)
+{
+    for (; node; node = node->sibling)
+    {
+        path[length] = ';';
+        int n = frame_name(node, symbols, path + length + 1, 4096 - length - 1);
+        size_t end = length + 1 + n;
+        if (end >= 4096)
+            end = 4095;
+        if (node->cycles)
+            fprintf(folded, "%.*s %lu\n", (int)end, path, node->cycles);
+        write_folded(node->child, symbols, folded, path, end);
+    }
+}
+
+void callstack_report(CPU *cpu, Symbols *symbols, FILE *folded)
+{
+    CallStack *callstack = cpu->callstack;
+    char path[4096];
+
+    charge(callstack, cpu);
+    size_t length = snprintf(path, sizeof(path), "entry");
+
+    if (callstack->root.cycles)
+        fprintf(folded, "%s %lu\n", path, callstack->root.cycles);
+    write_folded(callstack->root.child, symbols, folded, path, length);
+}
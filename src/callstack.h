@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "symbols.h"
+#define CALLSTACK_MAX_DEPTH 256
+#define CALLSTACK_OUTPUT "callstack.folded"
+
+// Guest call-stack tracking, built with `make CALLSTACK=1`. Without
+// CALLSTACK the hooks compile to nothing.
+#ifdef CALLSTACK
+#define CALLSTACK_CALL(cpu) \
+    do { if ((cpu)->callstack) callstack_call(cpu, false); } while (0)
+#define CALLSTACK_INTERRUPT(cpu) \
+    do { if ((cpu)->callstack) callstack_call(cpu, true); } while (0)
+#define CALLSTACK_RETURN(cpu) \
+    do { if ((cpu)->callstack) callstack_return(cpu); } while (0)
+#else
+#define CALLSTACK_CALL(cpu) ((void)0)
+#define CALLSTACK_INTERRUPT(cpu) ((void)0)
+#define CALLSTACK_RETURN(cpu) ((void)0)
+#endif
+
+// One node per distinct call path, keyed by the callee's entry point
+typedef struct CallNode
+{
+    __uint8_t bank;
+    __uint16_t address;
+    bool interrupt;
+    __uint64_t calls;
+    __uint64_t cycles; // spent in this function itself on this path
+    struct CallNode *parent;
+    struct CallNode *child;
+    struct CallNode *sibling;
+} CallNode;
+
+typedef struct CallFrame
+{
+    CallNode *node;
+    __uint16_t sp; // where the return address was pushed
+} CallFrame;
+
+typedef struct CallStack
+{
+    CallNode root; // code run outside any tracked call
+    CallFrame frames[CALLSTACK_MAX_DEPTH];
+    int depth;
+    __uint64_t last_cycles;
+    __uint64_t unmatched_returns;
+    __uint64_t dropped_calls;
+} CallStack;
+
+CallStack *callstack_init(CPU *cpu);
+void callstack_free(CallStack *callstack);
+void callstack_call(CPU *cpu, bool interrupt);
+void callstack_return(CPU *cpu);
+void callstack_report(CPU *cpu, Symbols *symbols, FILE *folded);
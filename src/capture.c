@@ -0,0 +1,145 @@
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "capture.h"
+#include "apu.h"
+
+// Capture is complete rather than lossy: capture_push only blocks when the
+// writer falls a full ring (over a second of sound) behind, and the
+// checksum is computed on the writer thread so checksum runs cost the
+// emulation thread no more than writing does.
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static void write_wav_header(Capture *capture)
+{
+    __uint32_t data = capture->frames * 4;
+    __uint32_t header[11] = {
+        0x46464952, 36 + data,                      // "RIFF", size of the rest
+        0x45564157, 0x20746D66, 16,                 // "WAVE", "fmt " chunk
+        0x00020001,                                 // PCM, 2 channels
+        APU_SAMPLE_RATE, APU_SAMPLE_RATE * 4,       // sample rate, bytes per second
+        0x00100004,                                 // 4 bytes per frame, 16 bits
+        0x61746164, data};                          // "data" chunk
+
+    fseek(capture->file, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, capture->file);
+}
+
+static __uint64_t hash_samples(__uint64_t hash, const __int16_t *samples, __uint64_t count)
+{
+    for (__uint64_t i = 0; i < count; i++)
+    {
+        hash = (hash ^ (samples[i] & 0xFF)) * FNV_PRIME;
+        hash = (hash ^ ((__uint16_t)samples[i] >> 8)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static void *writer_main(void *arg)
+{
+    Capture *capture = arg;
+    struct timespec idle = {0, 1000000};
+
+    for (;;)
+    {
+        __uint64_t head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+        __uint64_t tail = capture->tail;
+        if (head == tail)
+        {
+            if (__atomic_load_n(&capture->closing, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE) == tail)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        // Up to the end of the ring, the rest goes out on the next pass
+        __uint64_t start = tail & (CAPTURE_RING_FRAMES - 1);
+        __uint64_t count = head - tail;
+        if (count > CAPTURE_RING_FRAMES - start)
+            count = CAPTURE_RING_FRAMES - start;
+        if (count > CAPTURE_CHUNK)
+            count = CAPTURE_CHUNK;
+        const __int16_t *samples = &capture->ring[start * 2];
+        capture->checksum = hash_samples(capture->checksum, samples, count * 2);
+        if (capture->file && fwrite(samples, 4, count, capture->file) != count)
+        {
+            perror("Error writing audio capture");
+            exit(1);
+        }
+        capture->frames += count;
+        __atomic_store_n(&capture->tail, tail + count, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+Capture *capture_open(const char *path)
+{
+    Capture *capture = calloc(1, sizeof(Capture));
+    capture->checksum = FNV_OFFSET;
+    if (path)
+    {
+        size_t length = strlen(path);
+        capture->wav = length >= 4 && strcasecmp(path + length - 4, ".wav") == 0;
+        capture->file = fopen(path, "wb");
+        if (capture->file == NULL)
+        {
+            perror("Error opening audio capture file");
+            exit(1);
+        }
+        if (capture->wav)
+            write_wav_header(capture); // sizes are filled in by capture_close
+    }
+    capture->ring = malloc(CAPTURE_RING_FRAMES * 2 * sizeof(__int16_t));
+    if (capture->ring == NULL)
+    {
+        printf("Failed to allocate audio capture ring\n");
+        exit(1);
+    }
+    if (pthread_create(&capture->writer, NULL, writer_main, capture) != 0)
+    {
+        printf("Failed to start audio capture writer\n");
+        exit(1);
+    }
+    return capture;
+}
+
+void capture_close(Capture *capture)
+{
+    if (capture == NULL)
+        return;
+    __atomic_store_n(&capture->closing, true, __ATOMIC_RELEASE);
+    pthread_join(capture->writer, NULL);
+    if (capture->file)
+    {
+        if (capture->wav)
+            write_wav_header(capture);
+        fclose(capture->file);
+    }
+    free(capture->ring);
+    capture->ring = NULL;
+}
+
+void capture_push(Capture *capture, const __int16_t *frames, int count)
+{
+    __uint64_t head = capture->head;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (head + i - __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE) == CAPTURE_RING_FRAMES)
+        {
+            capture->stalls++;
+            __atomic_store_n(&capture->head, head + i, __ATOMIC_RELEASE);
+            while (head + i - __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE) == CAPTURE_RING_FRAMES)
+                sched_yield();
+        }
+        __uint64_t index = (head + i) & (CAPTURE_RING_FRAMES - 1);
+        capture->ring[2 * index] = frames[2 * i];
+        capture->ring[2 * index + 1] = frames[2 * i + 1];
+    }
+    __atomic_store_n(&capture->head, head + count, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#define CAPTURE_RING_FRAMES (1 << 16) // stereo frames, power of two
+#define CAPTURE_CHUNK 4096            // frames per fwrite
+
+// Records the APU output (48 kHz, 16-bit stereo) for audio regression
+// tests: as a WAV file, as raw little-endian PCM, or only as a checksum.
+// Single-producer ring like the instruction trace: the APU appends whole
+// frames, a writer thread hashes and writes them.
+typedef struct Capture
+{
+    __int16_t *ring;
+    __uint64_t head; // written by the emulation thread
+    __uint64_t tail; // written by the writer thread
+    bool closing;
+    FILE *file; // NULL in checksum-only mode
+    bool wav;
+    pthread_t writer;
+    __uint64_t frames;
+    __uint64_t checksum; // FNV-1a over the sample bytes, little-endian
+    __uint64_t stalls;   // times the emulation thread waited for the writer
+} Capture;
+
+// path NULL hashes the stream without writing it. A path ending in .wav
+// gets a WAV header, anything else raw PCM.
+Capture *capture_open(const char *path);
+// Drains the ring and closes the file; frames and checksum are final
+// afterwards, the Capture itself is the caller's to free
+void capture_close(Capture *capture);
+void capture_push(Capture *capture, const __int16_t *frames, int count);
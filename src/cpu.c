@@ -2,20 +2,18 @@
 #include "memory.h"
 #include "joypad.h"
 #include "timer.h"
+#include "jit.h"
+#include "recomp.h"
+#include "fusion.h"
+#include "profile.h"
+#include "sampler.h"
+#include "callstack.h"
+#include "trace.h"
+#include "sections.h"
 
 __uint8_t get_F(CPU *cpu);
-bool interrupt_pending(CPU *cpu);
-__uint8_t handle_interrupts(CPU *cpu, FILE *file);
 void update_IME(CPU *cpu, __uint8_t opcode);
 
-void print_cpu(CPU *cpu, FILE *file)
-{
-    return;
-    fprintf(file, "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
-            cpu->registers.A, get_F(cpu), cpu->registers.B, cpu->registers.C, cpu->registers.D, cpu->registers.E, cpu->registers.H,
-            cpu->registers.L, cpu->SP, cpu->PC, read_memory(cpu, cpu->PC), read_memory(cpu, cpu->PC + 1), read_memory(cpu, cpu->PC + 2), read_memory(cpu, cpu->PC + 3));
-}
-
 __int16_t sign_extend(__uint8_t value)
 {
     return (__int16_t)((__int8_t)value);
@@ -1389,6 +1387,7 @@ __uint8_t CALL_CC_n16(CPU *cpu, __uint8_t cc)
     }
     PUSH_PC(cpu);
     cpu->PC = a16;
+    CALLSTACK_CALL(cpu);
     update_timer(cpu, 4);
     return 24;
 }
@@ -1399,6 +1398,7 @@ __uint8_t CALL_n16(CPU *cpu)
 
     PUSH_PC(cpu);
     cpu->PC = a16;
+    CALLSTACK_CALL(cpu);
     update_timer(cpu, 4);
     return 24;
 }
@@ -1407,6 +1407,7 @@ __uint8_t RST_vec(CPU *cpu, __uint8_t address)
 {
     PUSH_PC(cpu);
     cpu->PC = address;
+    CALLSTACK_CALL(cpu);
     update_timer(cpu, 4);
     return 16;
 }
@@ -1419,6 +1420,7 @@ __uint8_t RET_CC(CPU *cpu, __uint8_t cc)
         return 8;
     }
 
+    CALLSTACK_RETURN(cpu);
     cpu->PC = get_SP(cpu);
     update_timer(cpu, 8);
     return 20;
@@ -1426,6 +1428,7 @@ __uint8_t RET_CC(CPU *cpu, __uint8_t cc)
 
 __uint8_t RET(CPU *cpu)
 {
+    CALLSTACK_RETURN(cpu);
     __uint8_t v1 = read_memory(cpu, cpu->SP++);
     update_timer(cpu, 4);
     __uint8_t v2 = read_memory(cpu, cpu->SP++);
@@ -1439,6 +1442,7 @@ __uint8_t RET(CPU *cpu)
 
 __uint8_t RETI(CPU *cpu)
 {
+    CALLSTACK_RETURN(cpu);
     __uint16_t a16 = get_SP(cpu);
     cpu->PC = a16;
     update_timer(cpu, 4);
@@ -2227,11 +2231,12 @@ __uint8_t exec_CB(CPU *cpu)
         exit(1);
         break;
     }
+    PROFILE_CB(opcode, t_cycles);
 
     return t_cycles;
 }
 
-__uint8_t CPU_step(CPU *cpu, FILE *file)
+__uint8_t exec_opcode(CPU *cpu)
 {
     __uint8_t opcode = read_opcode(cpu);
     __uint8_t t_cycles = 4;
@@ -2982,9 +2987,17 @@ __uint8_t CPU_step(CPU *cpu, FILE *file)
     }
 
     update_IME(cpu, opcode);
-    __uint8_t handled = handle_interrupts(cpu, file);
+    PROFILE_OPCODE(opcode, t_cycles);
+
+    return t_cycles;
+}
+
+__uint8_t CPU_step(CPU *cpu)
+{
+    __uint8_t t_cycles = exec_opcode(cpu);
+    __uint8_t handled = handle_interrupts(cpu);
     if (!handled)
-        print_cpu(cpu, file);
+        TRACE_INSTRUCTION(cpu);
 
     return t_cycles;
 }
@@ -2998,13 +3011,13 @@ void update_IME(CPU *cpu, __uint8_t opcode)
     }
 }
 
-__uint8_t handle_interrupts(CPU *cpu, FILE *file)
+__uint8_t handle_interrupts(CPU *cpu)
 {
     if (!cpu->IME || !interrupt_pending(cpu))
         return 0;
 
     cpu->IME = 0;
-    print_cpu(cpu, file);
+    TRACE_INSTRUCTION(cpu);
     update_timer(cpu, 8);
     __uint8_t flags = cpu->memory[IE] & cpu->memory[IF];
     PUSH_PC(cpu);
@@ -3014,6 +3027,7 @@ __uint8_t handle_interrupts(CPU *cpu, FILE *file)
         // printf("vblank handle\n");
         cpu->memory[0xFF0F] &= ~(1u);
         cpu->PC = VBLANK_ADDR;
+        CALLSTACK_INTERRUPT(cpu);
         update_timer(cpu, 4);
         return 1;
     }
@@ -3022,6 +3036,7 @@ __uint8_t handle_interrupts(CPU *cpu, FILE *file)
         // printf("lcd handle\n");
         cpu->memory[0xFF0F] &= ~(1u << 1);
         cpu->PC = LCD_STAT_ADDR;
+        CALLSTACK_INTERRUPT(cpu);
         update_timer(cpu, 4);
         return 1;
     }
@@ -3030,6 +3045,7 @@ __uint8_t handle_interrupts(CPU *cpu, FILE *file)
         // printf("timer handle\n");
         cpu->memory[0xFF0F] &= ~(1u << 2);
         cpu->PC = TIMER_ADDR;
+        CALLSTACK_INTERRUPT(cpu);
         update_timer(cpu, 4);
         return 1;
     }
@@ -3038,6 +3054,7 @@ __uint8_t handle_interrupts(CPU *cpu, FILE *file)
         // printf("serial handle\n");
         cpu->memory[0xFF0F] &= ~(1u << 3);
         cpu->PC = SERIAL_ADDR;
+        CALLSTACK_INTERRUPT(cpu);
         update_timer(cpu, 4);
         return 1;
     }
@@ -3046,6 +3063,7 @@ __uint8_t handle_interrupts(CPU *cpu, FILE *file)
         printf("joypad handle\n");
         cpu->memory[0xFF0F] &= ~(1u << 4);
         cpu->PC = JOYPAD_ADDR;
+        CALLSTACK_INTERRUPT(cpu);
         update_timer(cpu, 4);
         return 1;
     }
@@ -3058,7 +3076,69 @@ bool interrupt_pending(CPU *cpu)
     return (cpu->memory[IE] & cpu->memory[IF] & 0x1F) != 0;
 }
 
-void CPU_init(CPU *cpu, Fetcher *fetcher, const char *filename, SDL_Window *window, SDL_Renderer *renderer, FILE *file)
+Host CPU_host(CPU *cpu)
+{
+    return (Host){
+        .cartridge = cpu->cartridge,
+        .fetcher = cpu->fetcher,
+        .display = cpu->display,
+        .audio = cpu->audio,
+        .capture = cpu->capture,
+        .recorder = cpu->recorder,
+        .movie = cpu->movie,
+        .serial = cpu->serial,
+        .jit = cpu->jit,
+        .fusion = cpu->fusion,
+        .sampler = cpu->sampler,
+        .callstack = cpu->callstack,
+        .trace = cpu->trace,
+        .pacer = cpu->pacer,
+        .frame_limit = cpu->frame_limit,
+        .cycle_limit = cpu->cycle_limit,
+        .skip_pixels = cpu->skip_pixels,
+        .host_buttons = cpu->host_buttons,
+    };
+}
+
+void CPU_set_host(CPU *cpu, const Host *host)
+{
+    cpu->cartridge = host->cartridge;
+    cpu->fetcher = host->fetcher;
+    cpu->display = host->display;
+    cpu->audio = host->audio;
+    cpu->capture = host->capture;
+    cpu->recorder = host->recorder;
+    cpu->movie = host->movie;
+    cpu->serial = host->serial;
+    cpu->jit = host->jit;
+    cpu->fusion = host->fusion;
+    cpu->sampler = host->sampler;
+    cpu->callstack = host->callstack;
+    cpu->trace = host->trace;
+    cpu->pacer = host->pacer;
+    cpu->frame_limit = host->frame_limit;
+    cpu->cycle_limit = host->cycle_limit;
+    cpu->skip_pixels = host->skip_pixels;
+    cpu->host_buttons = host->host_buttons;
+}
+
+Host CPU_silent_host(const Host *host)
+{
+    Host silent = *host;
+    silent.display = NULL;
+    silent.audio = NULL;
+    silent.capture = NULL;
+    silent.recorder = NULL;
+    silent.movie = NULL;
+    silent.serial = NULL;
+    silent.callstack = NULL;
+    silent.trace = NULL;
+    silent.pacer = NULL;
+    silent.skip_pixels = true;
+    return silent;
+}
+
+void CPU_init(CPU *cpu, Fetcher *fetcher, const char *filename, Display *display)
 {
     cpu->cartridge = load_cartridge(filename);
     cpu->registers.A = 0x01;
@@ -3078,20 +3158,23 @@ void CPU_init(CPU *cpu, Fetcher *fetcher, const char *filename, SDL_Window *wind
     cpu->C = 1;
     cpu->memory[IO_JOYPAD] = 0xFF; // all buttons released
     cpu->ppu.prev_ly = 0xFF;
-    print_cpu(cpu, file);
+    apu_init(cpu);
 
-    cpu->window = window;
-    cpu->renderer = renderer;
+    cpu->display = display;
 
     cpu->fetcher = fetcher;
 }
 
-void CPU_start(CPU *cpu, SDL_Event *e, FILE *file)
+void CPU_start(CPU *cpu, SDL_Event *e)
 {
     bool quit = false;
     while (!quit)
     {
-        while (SDL_PollEvent(e) != 0)
+        if (cpu->frame_limit && cpu->frames >= cpu->frame_limit)
+            break;
+        if (cpu->cycle_limit && cpu->cycles >= cpu->cycle_limit)
+            break;
+        while (e && SDL_PollEvent(e) != 0)
         {
             if (e->type == SDL_QUIT)
             {
@@ -3106,6 +3189,8 @@ void CPU_start(CPU *cpu, SDL_Event *e, FILE *file)
         }
 
         update_joypad(cpu);
+        if (cpu->sampler)
+            sampler_tick(cpu);
         // bool halt_bug = 0;
         //  TODO: fix halt bug implementation
         if (cpu->halted)
@@ -3117,7 +3202,7 @@ void CPU_start(CPU *cpu, SDL_Event *e, FILE *file)
                 cpu->halted = 0;
                 if (cpu->IME)
                 {
-                    handle_interrupts(cpu, file);
+                    handle_interrupts(cpu);
                     continue;
                 }
                 // else
@@ -3129,6 +3214,15 @@ void CPU_start(CPU *cpu, SDL_Event *e, FILE *file)
         if (cpu->halted)
             continue;
 
-        CPU_step(cpu, file);
+        SECTION_ENTER(SECTION_CPU);
+        if (recomp_run)
+            recomp_step(cpu);
+        else if (cpu->jit)
+            jit_step(cpu);
+        else if (cpu->fusion)
+            fusion_step(cpu);
+        else
+            CPU_step(cpu);
+        SECTION_LEAVE();
     }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <SDL2/SDL.h>
 #include "ppu.h"
+#include "apu.h"
 #define VBLANK_ADDR 0x0040
 #define LCD_STAT_ADDR 0x0048
 #define TIMER_ADDR 0x0050
@@ -17,6 +18,18 @@
 typedef struct PPU PPU;
 typedef struct Cartridge Cartridge;
 typedef struct Fetcher Fetcher;
+typedef struct Jit Jit;
+typedef struct Fusion Fusion;
+typedef struct Sampler Sampler;
+typedef struct CallStack CallStack;
+typedef struct Trace Trace;
+typedef struct Pacer Pacer;
+typedef struct Display Display;
+typedef struct Audio Audio;
+typedef struct Capture Capture;
+typedef struct Recorder Recorder;
+typedef struct Movie Movie;
+typedef struct Serial Serial;
 
 typedef struct Registers
 {
@@ -32,8 +45,14 @@ typedef struct Registers
 
 typedef struct CPU
 {
+    __uint64_t cycles; // T-cycles since power on
+    __uint64_t frames; // frames completed since power on
+    __uint64_t frame_limit; // CPU_start returns after this many frames, 0 runs until quit
+    __uint64_t cycle_limit; // or once cycles reaches this, 0 for no limit
+    __uint8_t buttons; // held this frame, BUTTON_* bits
     __uint16_t div_cycles;
     __uint16_t tima_cycles;
+    __uint16_t serial_cycles; // until serial_update is due, 0 while the link port is idle
     // __uint8_t current_t_cycles;
     __uint8_t halted;
     __uint8_t halt_bug;
@@ -47,18 +66,69 @@ typedef struct CPU
     __uint8_t IME; // IME flag
     bool ime_delay;
     PPU ppu;
+    APU apu;
     __uint8_t memory[0xFFFF];
     Cartridge *cartridge;
-    // TODO: remove this
-    SDL_Window *window;
-    SDL_Renderer *renderer;
+    Display *display; // NULL when headless
+    Audio *audio;     // NULL skips sound synthesis
+    Capture *capture; // NULL when not recording sound
+    Recorder *recorder; // NULL when not recording video
+    Movie *movie;       // input being recorded or played back
+    Serial *serial;     // NULL doesn't keep the bytes sent
     Fetcher *fetcher;
     __uint8_t dma_cycles;
     bool vblank;
     bool hblank;
     bool oam_scan;
     bool pixel_transfer;
+    Jit *jit; // NULL when running on the interpreter only
+    Fusion *fusion;
+    Sampler *sampler;
+    CallStack *callstack; // only used by CALLSTACK builds
+    Trace *trace;         // only used by TRACE builds
+    Pacer *pacer;         // NULL runs unthrottled
+    bool skip_pixels;     // keep the PPU's timing but draw nothing, for frames nobody sees
+    __uint8_t host_buttons; // joypad_frame's input without a display
 } CPU;
 
-void CPU_init(CPU *cpu, Fetcher *fetcher, const char *filename, SDL_Window *window, SDL_Renderer *renderer, FILE *file);
-void CPU_start(CPU *cpu, SDL_Event *e, FILE *file);
\ No newline at end of file
+// The fields of CPU that belong to the host rather than to the emulated
+// machine: the cartridge and fetcher it runs with, where its output goes,
+// the engines and tools attached to it and how far it runs. Save states
+// and the JIT's reference runs take the machine without them, and frames
+// run again or ahead swap in a silent host. Every such field is listed
+// here, in CPU_host and in CPU_set_host.
+typedef struct Host
+{
+    Cartridge *cartridge;
+    Fetcher *fetcher;
+    Display *display;
+    Audio *audio;
+    Capture *capture;
+    Recorder *recorder;
+    Movie *movie;
+    Serial *serial;
+    Jit *jit;
+    Fusion *fusion;
+    Sampler *sampler;
+    CallStack *callstack;
+    Trace *trace;
+    Pacer *pacer;
+    __uint64_t frame_limit;
+    __uint64_t cycle_limit;
+    bool skip_pixels;
+    __uint8_t host_buttons;
+} Host;
+
+void CPU_init(CPU *cpu, Fetcher *fetcher, const char *filename, Display *display);
+void CPU_start(CPU *cpu, SDL_Event *e); // e NULL runs without SDL event polling
+__uint8_t CPU_step(CPU *cpu);
+__uint8_t exec_opcode(CPU *cpu);
+__uint8_t handle_interrupts(CPU *cpu);
+bool interrupt_pending(CPU *cpu);
+Host CPU_host(CPU *cpu);
+void CPU_set_host(CPU *cpu, const Host *host);
+// host for frames nobody sees or hears, which the machine runs and then
+// leaves: nothing shown, played, recorded, traced, paced or sent over the
+// link, no movie input, no call stack kept and no pixels drawn. The engines,
+// the sampler and the limits stay.
+Host CPU_silent_host(const Host *host);
\ No newline at end of file
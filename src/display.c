@@ -0,0 +1,115 @@
+#include <string.h>
+#include <time.h>
+#include "display.h"
+#include "ppu.h"
+
+// Triple buffer: the emulation thread fills back and swaps it with
+// middle; the present thread swaps its front with middle whenever middle
+// is marked fresh. Neither side ever waits for the other: a slow present
+// just means intermediate frames are replaced before they're shown. The
+// semaphore only wakes the present thread, sem_post doesn't block.
+
+static __uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *present_main(void *arg)
+{
+    Display *display = arg;
+
+    // SDL wants the renderer used from the thread that created it
+    display->renderer = SDL_Renderer_init(display->window, display->vsync);
+    for (;;)
+    {
+        sem_wait(&display->published_frame);
+        if (__atomic_load_n(&display->quit, __ATOMIC_ACQUIRE))
+            break;
+        if (!(__atomic_load_n(&display->middle, __ATOMIC_ACQUIRE) & DISPLAY_FRESH))
+            continue;
+        display->front = __atomic_exchange_n(&display->middle, display->front, __ATOMIC_ACQ_REL) & ~DISPLAY_FRESH;
+        if (display->renderer)
+            display_frame(display->window, display->renderer, display->buffers[display->front]);
+        display->presented++;
+    }
+    if (display->renderer)
+        SDL_DestroyRenderer(display->renderer);
+    return NULL;
+}
+
+Display *display_init(SDL_Window *window, bool vsync, bool threaded)
+{
+    Display *display = calloc(1, sizeof(Display));
+    display->window = window;
+    display->vsync = vsync;
+    display->threaded = threaded;
+    display->back = 0;
+    display->middle = 1;
+    display->front = 2;
+
+    if (!threaded)
+    {
+        display->renderer = SDL_Renderer_init(window, vsync);
+        return display;
+    }
+    sem_init(&display->published_frame, 0, 0);
+    if (pthread_create(&display->thread, NULL, present_main, display) != 0)
+    {
+        printf("Failed to start present thread\n");
+        exit(1);
+    }
+    return display;
+}
+
+void display_free(Display *display)
+{
+    if (display == NULL)
+        return;
+    if (display->threaded)
+    {
+        __atomic_store_n(&display->quit, true, __ATOMIC_RELEASE);
+        sem_post(&display->published_frame);
+        pthread_join(display->thread, NULL);
+        sem_destroy(&display->published_frame);
+    }
+    else if (display->renderer)
+        SDL_DestroyRenderer(display->renderer);
+    free(display);
+}
+
+// Called by the PPU at the end of every frame
+void display_publish(Display *display, const __uint8_t *frame)
+{
+    __uint64_t start = now_ns();
+
+    if (display->threaded)
+    {
+        memcpy(display->buffers[display->back], frame, sizeof(display->buffers[0]));
+        display->back = __atomic_exchange_n(&display->middle, display->back | DISPLAY_FRESH, __ATOMIC_ACQ_REL) & ~DISPLAY_FRESH;
+        sem_post(&display->published_frame);
+    }
+    else if (display->renderer)
+    {
+        display_frame(display->window, display->renderer, (__uint8_t *)frame);
+        display->presented++;
+    }
+
+    __uint64_t stall = now_ns() - start;
+    display->published++;
+    display->stall_ns += stall;
+    if (stall > display->max_stall_ns)
+        display->max_stall_ns = stall;
+}
+
+void display_report(Display *display, FILE *out)
+{
+    if (display->published == 0)
+        return;
+    fprintf(out, "Display: %lu frames published, %lu presented (%s)\n", display->published,
+            __atomic_load_n(&display->presented, __ATOMIC_RELAXED),
+            display->threaded ? "present thread" : "synchronous");
+    fprintf(out, "Display: emulation thread stalled %.1f us per frame on average, %.1f us at most\n",
+            display->stall_ns / 1e3 / display->published, display->max_stall_ns / 1e3);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#define DISPLAY_FRESH 4 // set in Display.middle when it holds an unpresented frame
+
+// Hands finished frames from the PPU to the screen. Threaded, the frames
+// go through a lock-free triple buffer to a present thread that owns the
+// renderer; otherwise they're drawn and presented on the emulation thread.
+typedef struct Display
+{
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    bool vsync;
+    bool threaded;
+    __uint8_t buffers[3][144 * 160];
+    int back;   // emulation thread's buffer
+    int middle; // last published buffer, exchanged atomically
+    int front;  // present thread's buffer
+    bool quit;
+    sem_t published_frame;
+    pthread_t thread;
+    __uint64_t published;
+    __uint64_t presented;
+    __uint64_t stall_ns; // emulation thread time spent in display_publish
+    __uint64_t max_stall_ns;
+} Display;
+
+Display *display_init(SDL_Window *window, bool vsync, bool threaded);
+void display_free(Display *display);
+void display_publish(Display *display, const __uint8_t *frame);
+void display_report(Display *display, FILE *out);
@@ -0,0 +1,249 @@
+#include <string.h>
+#include "fusion.h"
+#include "joypad.h"
+#include "memory.h"
+#include "timer.h"
+#include "opcodes.h"
+#include "profile.h"
+#include "trace.h"
+
+// Superinstructions: short opcode sequences that dominate the pair
+// histogram (--dump-pairs, or make PROFILE=1) of common games, run as one
+// handler.
+//
+// A fused handler does exactly what consecutive CPU_step calls would: the
+// same update_timer ticks, IME update, interrupt check and trace record
+// after every instruction, and the joypad update CPU_start does between them. It saves
+// the per-instruction trip through CPU_start and the opcode switch. Before
+// each following instruction it re-reads the opcode at PC and stops if it
+// changed (bank switch or self-modifying code), and stops if an OAM DMA
+// started, whose stall CPU_start has to run first.
+
+#define FUSED_STEP(opcode, call)         \
+    cpu->PC++;                           \
+    update_timer(cpu, 4);                \
+    step_cycles = call;                  \
+    t_cycles += step_cycles;             \
+    update_IME(cpu, opcode);             \
+    PROFILE_OPCODE(opcode, step_cycles); \
+    if (handle_interrupts(cpu))          \
+        return t_cycles;                 \
+    TRACE_INSTRUCTION(cpu);
+
+#define FUSED_EXPECT(opcode)                                    \
+    if (cpu->dma_cycles || read_memory(cpu, cpu->PC) != opcode) \
+        return t_cycles;                                        \
+    update_joypad(cpu);
+
+static __uint8_t jr_condition(CPU *cpu, __uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x20:
+        return cpu->Z == 0;
+    case 0x28:
+        return cpu->Z == 1;
+    case 0x30:
+        return cpu->C == 0;
+    default:
+        return cpu->C == 1;
+    }
+}
+
+// LD A, [HL+]; LD [DE], A
+static __uint8_t LD_A_HLI_LD_DE_A(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x2A, LD_A_HLI(cpu));
+    FUSED_EXPECT(0x12);
+    FUSED_STEP(0x12, LD_DE_A(cpu));
+    return t_cycles;
+}
+
+// LD A, [HL+]; LDH [a8], A
+static __uint8_t LD_A_HLI_LD_a8_A(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x2A, LD_A_HLI(cpu));
+    FUSED_EXPECT(0xE0);
+    FUSED_STEP(0xE0, LD_a8_A(cpu));
+    return t_cycles;
+}
+
+// LD A, [HL+]; LD [a16], A
+static __uint8_t LD_A_HLI_LD_a16_A(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x2A, LD_A_HLI(cpu));
+    FUSED_EXPECT(0xEA);
+    FUSED_STEP(0xEA, LD_a16_A(cpu));
+    return t_cycles;
+}
+
+// DEC B; JR NZ, e8
+static __uint8_t DEC_B_JR_NZ(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x05, DEC_r8(cpu, &cpu->registers.B));
+    FUSED_EXPECT(0x20);
+    FUSED_STEP(0x20, JR_CC_n16(cpu, cpu->Z == 0));
+    return t_cycles;
+}
+
+// DEC C; JR NZ, e8
+static __uint8_t DEC_C_JR_NZ(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x0D, DEC_r8(cpu, &cpu->registers.C));
+    FUSED_EXPECT(0x20);
+    FUSED_STEP(0x20, JR_CC_n16(cpu, cpu->Z == 0));
+    return t_cycles;
+}
+
+// LDH A, [a8]; CP A, n8; JR cc, e8
+static __uint8_t LDH_CP_JR(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0xF0, LD_A_a8(cpu));
+    FUSED_EXPECT(0xFE);
+    FUSED_STEP(0xFE, CP_A_n8(cpu));
+
+    __uint8_t jr = read_memory(cpu, cpu->PC);
+    if (jr != 0x20 && jr != 0x28 && jr != 0x30 && jr != 0x38)
+        return t_cycles;
+    FUSED_STEP(jr, JR_CC_n16(cpu, jr_condition(cpu, jr)));
+    return t_cycles;
+}
+
+// LD [HL], A; INC HL
+static __uint8_t LD_HL_A_INC_HL(CPU *cpu)
+{
+    __uint8_t t_cycles = 0, step_cycles;
+    FUSED_STEP(0x77, LD_HL_r8(cpu, cpu->registers.A));
+    FUSED_EXPECT(0x23);
+    FUSED_STEP(0x23, INC_HL(cpu));
+    return t_cycles;
+}
+
+static const FusedOp fusion_table[] = {
+    {"LD A, [HL+]; LD [DE], A", 2, {0x2A, 0x12}, {0, 1}, LD_A_HLI_LD_DE_A},
+    {"LD A, [HL+]; LDH [a8], A", 2, {0x2A, 0xE0}, {0, 1}, LD_A_HLI_LD_a8_A},
+    {"LD A, [HL+]; LD [a16], A", 2, {0x2A, 0xEA}, {0, 1}, LD_A_HLI_LD_a16_A},
+    {"DEC B; JR NZ, e8", 2, {0x05, 0x20}, {0, 1}, DEC_B_JR_NZ},
+    {"DEC C; JR NZ, e8", 2, {0x0D, 0x20}, {0, 1}, DEC_C_JR_NZ},
+    {"LDH A, [a8]; CP A, n8; JR NZ, e8", 3, {0xF0, 0xFE, 0x20}, {0, 2, 4}, LDH_CP_JR},
+    {"LDH A, [a8]; CP A, n8; JR Z, e8", 3, {0xF0, 0xFE, 0x28}, {0, 2, 4}, LDH_CP_JR},
+    {"LDH A, [a8]; CP A, n8; JR NC, e8", 3, {0xF0, 0xFE, 0x30}, {0, 2, 4}, LDH_CP_JR},
+    {"LDH A, [a8]; CP A, n8; JR C, e8", 3, {0xF0, 0xFE, 0x38}, {0, 2, 4}, LDH_CP_JR},
+    {"LD [HL], A; INC HL", 2, {0x77, 0x23}, {0, 1}, LD_HL_A_INC_HL},
+};
+
+#define FUSION_TABLE_SIZE (sizeof(fusion_table) / sizeof(fusion_table[0]))
+
+static bool fusable[256];
+
+static const FusedOp *match(CPU *cpu, __uint8_t opcode)
+{
+    for (size_t i = 0; i < FUSION_TABLE_SIZE; i++)
+    {
+        const FusedOp *op = &fusion_table[i];
+        if (op->opcodes[0] != opcode)
+            continue;
+
+        __uint8_t n = 1;
+        while (n < op->count && read_memory(cpu, cpu->PC + op->offsets[n]) == op->opcodes[n])
+            n++;
+        if (n == op->count)
+            return op;
+    }
+    return NULL;
+}
+
+Fusion *fusion_init(bool enabled, bool count_pairs)
+{
+    Fusion *fusion = calloc(1, sizeof(Fusion));
+    fusion->enabled = enabled && !count_pairs; // the histogram is taken on the plain interpreter
+    fusion->fused = calloc(FUSION_TABLE_SIZE, sizeof(__uint64_t));
+    if (count_pairs)
+        fusion->pairs = calloc(256, sizeof(*fusion->pairs));
+    for (size_t i = 0; i < FUSION_TABLE_SIZE; i++)
+        fusable[fusion_table[i].opcodes[0]] = true;
+    return fusion;
+}
+
+void fusion_free(Fusion *fusion)
+{
+    if (fusion == NULL)
+        return;
+    free(fusion->pairs);
+    free(fusion->fused);
+    free(fusion);
+}
+
+void fusion_step(CPU *cpu)
+{
+    Fusion *fusion = cpu->fusion;
+    __uint8_t opcode = read_memory(cpu, cpu->PC);
+
+    if (fusion->pairs)
+    {
+        fusion->pairs[fusion->prev_opcode][opcode]++;
+        fusion->prev_opcode = opcode;
+    }
+    // OAM DMA stalls the CPU between instructions, so don't fuse across it
+    if (fusion->enabled && fusable[opcode] && cpu->dma_cycles == 0)
+    {
+        const FusedOp *op = match(cpu, opcode);
+        if (op)
+        {
+            fusion->fused[op - fusion_table]++;
+            op->handler(cpu);
+            return;
+        }
+    }
+    CPU_step(cpu);
+}
+
+void fusion_report(Fusion *fusion, FILE *out)
+{
+    for (size_t i = 0; i < FUSION_TABLE_SIZE; i++)
+    {
+        if (fusion->fused[i])
+            fprintf(out, "Fused %-36s %lu\n", fusion_table[i].name, fusion->fused[i]);
+    }
+}
+
+typedef struct PairCount
+{
+    __uint16_t pair;
+    __uint64_t count;
+} PairCount;
+
+static int compare_pairs(const void *a, const void *b)
+{
+    const PairCount *x = a;
+    const PairCount *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+void fusion_dump_pairs(Fusion *fusion, FILE *out)
+{
+    PairCount *counts = malloc(0x10000 * sizeof(PairCount));
+    __uint64_t total = 0;
+
+    for (int i = 0; i < 0x10000; i++)
+    {
+        counts[i].pair = i;
+        counts[i].count = fusion->pairs[i >> 8][i & 0xFF];
+        total += counts[i].count;
+    }
+    qsort(counts, 0x10000, sizeof(PairCount), compare_pairs);
+
+    fprintf(out, "# first second count percent\n");
+    for (int i = 0; i < 0x10000 && counts[i].count; i++)
+    {
+        fprintf(out, "%02X %02X %lu %.3f\n", counts[i].pair >> 8, counts[i].pair & 0xFF,
+                counts[i].count, 100.0 * counts[i].count / total);
+    }
+    free(counts);
+}
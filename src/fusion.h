@@ -0,0 +1,30 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include "cpu.h"
+#define FUSION_MAX_OPS 3
+
+typedef __uint8_t (*FusedHandler)(CPU *cpu);
+
+typedef struct FusedOp
+{
+    const char *name;
+    __uint8_t count;                    // instructions in the sequence
+    __uint8_t opcodes[FUSION_MAX_OPS];
+    __uint8_t offsets[FUSION_MAX_OPS]; // byte offset of each opcode from the first
+    FusedHandler handler;
+} FusedOp;
+
+typedef struct Fusion
+{
+    bool enabled;
+    __uint64_t (*pairs)[256]; // opcode-pair histogram, NULL unless dumping
+    __uint8_t prev_opcode;
+    __uint64_t *fused;        // executions per fusion_table entry
+} Fusion;
+
+Fusion *fusion_init(bool enabled, bool count_pairs);
+void fusion_free(Fusion *fusion);
+void fusion_step(CPU *cpu);
+void fusion_report(Fusion *fusion, FILE *out);
+void fusion_dump_pairs(Fusion *fusion, FILE *out);
@@ -0,0 +1,746 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "memory.h"
+#include "timer.h"
+
+// Dynamic recompiler for straight-line SM83 code.
+//
+// A block is a run of register-only instructions (8-bit loads, ALU ops,
+// INC/DEC, 16-bit INC/DEC/loads) optionally ended by a JR/JP. Blocks never
+// touch guest memory, so the only sync point needed is the block boundary:
+// jit_step ticks the timer/PPU in 4-cycle steps exactly like the interpreter
+// would and checks interrupts. Ticks don't depend on the registers a block
+// changes, so with IME set they're done first and the block is cut short
+// at the instruction after which the interpreter would take an interrupt.
+// Anything else (memory access, CALL/RET, CB prefix, EI/DI/HALT...) ends the
+// block and is run by CPU_step.
+//
+// Generated code keeps the CPU pointer in rbx and the instruction limit in
+// esi, and reads/writes the guest registers and flags straight from the CPU
+// struct. SM83 half-carry maps onto the x86 AF flag, read back with LAHF.
+
+#define JIT_BLOCK_CODE_MAX 4096
+#define JIT_TRANSLATED 0
+#define JIT_END_OF_BLOCK 1
+#define JIT_UNSUPPORTED 2
+
+// x86 8-bit register numbers
+#define X86_AL 0
+#define X86_CL 1
+#define X86_DL 2
+#define X86_AH 4
+
+#define OFF_A offsetof(CPU, registers.A)
+#define OFF_Z offsetof(CPU, Z)
+#define OFF_N offsetof(CPU, N)
+#define OFF_H offsetof(CPU, H)
+#define OFF_C offsetof(CPU, C)
+#define OFF_PC offsetof(CPU, PC)
+#define OFF_SP offsetof(CPU, SP)
+
+typedef struct Emitter
+{
+    __uint8_t *p;
+} Emitter;
+
+// Opcode register encoding: B, C, D, E, H, L, [HL], A
+static const size_t r8_offset[8] = {
+    offsetof(CPU, registers.B),
+    offsetof(CPU, registers.C),
+    offsetof(CPU, registers.D),
+    offsetof(CPU, registers.E),
+    offsetof(CPU, registers.H),
+    offsetof(CPU, registers.L),
+    0,
+    offsetof(CPU, registers.A),
+};
+
+// Register pairs BC, DE, HL as (high, low); SP is handled separately
+static const size_t r16_offset[3][2] = {
+    {offsetof(CPU, registers.B), offsetof(CPU, registers.C)},
+    {offsetof(CPU, registers.D), offsetof(CPU, registers.E)},
+    {offsetof(CPU, registers.H), offsetof(CPU, registers.L)},
+};
+
+#if defined(__x86_64__)
+
+static void emit8(Emitter *e, __uint8_t byte)
+{
+    *e->p++ = byte;
+}
+
+static void emit16(Emitter *e, __uint16_t value)
+{
+    emit8(e, value & 0xFF);
+    emit8(e, value >> 8);
+}
+
+static void emit32(Emitter *e, __uint32_t value)
+{
+    emit16(e, value & 0xFFFF);
+    emit16(e, value >> 16);
+}
+
+// ModRM for [rbx + disp32] with the given reg field
+static void emit_rbx(Emitter *e, __uint8_t reg, size_t offset)
+{
+    emit8(e, 0x83 | (reg << 3));
+    emit32(e, offset);
+}
+
+static void emit_load8(Emitter *e, __uint8_t reg, size_t offset)
+{
+    emit8(e, 0x8A);
+    emit_rbx(e, reg, offset);
+}
+
+static void emit_store8(Emitter *e, __uint8_t reg, size_t offset)
+{
+    emit8(e, 0x88);
+    emit_rbx(e, reg, offset);
+}
+
+static void emit_store_imm8(Emitter *e, size_t offset, __uint8_t value)
+{
+    emit8(e, 0xC6);
+    emit_rbx(e, 0, offset);
+    emit8(e, value);
+}
+
+static void emit_setcc(Emitter *e, __uint8_t cc, size_t offset)
+{
+    emit8(e, 0x0F);
+    emit8(e, cc);
+    emit_rbx(e, 0, offset);
+}
+
+// Z from ZF, optionally C from CF, H from AF (via LAHF)
+static void emit_flags(Emitter *e, bool carry)
+{
+    emit_setcc(e, 0x94, OFF_Z); // setz
+    if (carry)
+        emit_setcc(e, 0x92, OFF_C); // setc
+    emit8(e, 0x9F);                 // lahf
+    emit8(e, 0x88);                 // mov dl, ah
+    emit8(e, 0xC0 | (X86_AH << 3) | X86_DL);
+    emit8(e, 0xC0); // shr dl, 4
+    emit8(e, 0xEA);
+    emit8(e, 4);
+    emit8(e, 0x80); // and dl, 1
+    emit8(e, 0xE2);
+    emit8(e, 1);
+    emit_store8(e, X86_DL, OFF_H);
+}
+
+static void emit_prologue(Emitter *e)
+{
+    emit8(e, 0x53); // push rbx
+    emit8(e, 0x48); // mov rbx, rdi
+    emit8(e, 0x89);
+    emit8(e, 0xFB);
+}
+
+static void emit_exit(Emitter *e, __uint16_t pc, __uint32_t t_cycles)
+{
+    emit8(e, 0x66); // mov word [rbx + PC], pc
+    emit8(e, 0xC7);
+    emit_rbx(e, 0, OFF_PC);
+    emit16(e, pc);
+    emit8(e, 0xB8); // mov eax, t_cycles
+    emit32(e, t_cycles);
+    emit8(e, 0x5B); // pop rbx
+    emit8(e, 0xC3); // ret
+}
+
+// Leave the block before the next instruction once the limit is used up
+static void emit_limit_check(Emitter *e, __uint16_t next_pc, __uint32_t t_cycles)
+{
+    emit8(e, 0xFF); // dec esi
+    emit8(e, 0xCE);
+    emit8(e, 0x75); // jnz over the exit
+    __uint8_t *rel = e->p;
+    emit8(e, 0);
+    emit_exit(e, next_pc, t_cycles);
+    *rel = e->p - (rel + 1);
+}
+
+// Exit to taken_pc when the flag at offset matches want_set, else to next_pc
+static void emit_branch_exit(Emitter *e, size_t flag_offset, bool want_set,
+                             __uint16_t taken_pc, __uint32_t taken_cycles,
+                             __uint16_t next_pc, __uint32_t next_cycles)
+{
+    emit8(e, 0x80); // cmp byte [rbx + flag], 0
+    emit_rbx(e, 7, flag_offset);
+    emit8(e, 0);
+    emit8(e, 0x0F); // jne/je rel32
+    emit8(e, want_set ? 0x85 : 0x84);
+    __uint8_t *rel = e->p;
+    emit32(e, 0);
+    emit_exit(e, next_pc, next_cycles);
+    __uint32_t distance = e->p - (rel + 4);
+    memcpy(rel, &distance, sizeof(distance));
+    emit_exit(e, taken_pc, taken_cycles);
+}
+
+// ADD, ADC, SUB, SBC, AND, XOR, OR, CP on A with the operand in cl
+static void emit_alu(Emitter *e, __uint8_t op)
+{
+    static const __uint8_t x86_op[8] = {0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38};
+
+    emit_load8(e, X86_AL, OFF_A);
+    if (op == 1 || op == 3) // carry in: CF = (C != 0)
+    {
+        emit_load8(e, X86_DL, OFF_C);
+        emit8(e, 0x80); // add dl, 0xFF
+        emit8(e, 0xC2);
+        emit8(e, 0xFF);
+    }
+    emit8(e, x86_op[op]); // op al, cl
+    emit8(e, 0xC0 | (X86_CL << 3) | X86_AL);
+
+    if (op <= 3 || op == 7)
+    {
+        emit_flags(e, true);
+        emit_store_imm8(e, OFF_N, op >= 2);
+    }
+    else
+    {
+        emit_setcc(e, 0x94, OFF_Z);
+        emit_store_imm8(e, OFF_N, 0);
+        emit_store_imm8(e, OFF_H, op == 4);
+        emit_store_imm8(e, OFF_C, 0);
+    }
+    if (op != 7)
+        emit_store8(e, X86_AL, OFF_A);
+}
+
+static void emit_inc_dec_r16(Emitter *e, __uint8_t pair, bool inc)
+{
+    if (pair == 3)
+    {
+        emit8(e, 0x66); // inc/dec word [rbx + SP]
+        emit8(e, 0xFF);
+        emit_rbx(e, inc ? 0 : 1, OFF_SP);
+        return;
+    }
+    emit8(e, 0x0F); // movzx eax, byte [rbx + high]
+    emit8(e, 0xB6);
+    emit_rbx(e, X86_AL, r16_offset[pair][0]);
+    emit8(e, 0xC1); // shl eax, 8
+    emit8(e, 0xE0);
+    emit8(e, 8);
+    emit8(e, 0x0A); // or al, [rbx + low]
+    emit_rbx(e, X86_AL, r16_offset[pair][1]);
+    emit8(e, 0xFF); // inc/dec eax
+    emit8(e, inc ? 0xC0 : 0xC8);
+    emit_store8(e, X86_AL, r16_offset[pair][1]);
+    emit_store8(e, X86_AH, r16_offset[pair][0]);
+}
+
+static int translate(Emitter *e, CPU *cpu, __uint16_t pc, __uint32_t *t_cycles, __uint8_t *length)
+{
+    __uint8_t opcode = read_memory(cpu, pc);
+    __uint8_t n8 = read_memory(cpu, pc + 1);
+    __uint16_t n16 = n8 | (read_memory(cpu, pc + 2) << 8);
+    __uint8_t dst = (opcode >> 3) & 7;
+    __uint8_t src = opcode & 7;
+
+    *length = 1;
+
+    if (opcode >= 0x40 && opcode < 0x80) // LD r8, r8
+    {
+        if (dst == 6 || src == 6)
+            return JIT_UNSUPPORTED;
+        emit_load8(e, X86_AL, r8_offset[src]);
+        emit_store8(e, X86_AL, r8_offset[dst]);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    }
+    if (opcode >= 0x80 && opcode < 0xC0) // ALU A, r8
+    {
+        if (src == 6)
+            return JIT_UNSUPPORTED;
+        emit_load8(e, X86_CL, r8_offset[src]);
+        emit_alu(e, dst);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    }
+    if ((opcode & 0xC7) == 0xC6) // ALU A, n8
+    {
+        emit8(e, 0xB1); // mov cl, n8
+        emit8(e, n8);
+        emit_alu(e, dst);
+        *t_cycles += 8;
+        *length = 2;
+        return JIT_TRANSLATED;
+    }
+    if (opcode < 0x40 && dst != 6 && (src == 4 || src == 5)) // INC/DEC r8
+    {
+        emit_load8(e, X86_AL, r8_offset[dst]);
+        emit8(e, 0xFE);
+        emit8(e, src == 4 ? 0xC0 : 0xC8);
+        emit_flags(e, false);
+        emit_store_imm8(e, OFF_N, src == 5);
+        emit_store8(e, X86_AL, r8_offset[dst]);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    }
+    if (opcode < 0x40 && dst != 6 && src == 6) // LD r8, n8
+    {
+        emit_store_imm8(e, r8_offset[dst], n8);
+        *t_cycles += 8;
+        *length = 2;
+        return JIT_TRANSLATED;
+    }
+
+    switch (opcode)
+    {
+    case 0x00: // NOP
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    case 0x01: // LD BC, n16
+    case 0x11: // LD DE, n16
+    case 0x21: // LD HL, n16
+        emit_store_imm8(e, r16_offset[opcode >> 4][0], n16 >> 8);
+        emit_store_imm8(e, r16_offset[opcode >> 4][1], n16 & 0xFF);
+        *t_cycles += 12;
+        *length = 3;
+        return JIT_TRANSLATED;
+    case 0x31: // LD SP, n16
+        emit8(e, 0x66);
+        emit8(e, 0xC7);
+        emit_rbx(e, 0, OFF_SP);
+        emit16(e, n16);
+        *t_cycles += 12;
+        *length = 3;
+        return JIT_TRANSLATED;
+    case 0x03: // INC BC
+    case 0x13: // INC DE
+    case 0x23: // INC HL
+    case 0x33: // INC SP
+    case 0x0B: // DEC BC
+    case 0x1B: // DEC DE
+    case 0x2B: // DEC HL
+    case 0x3B: // DEC SP
+        emit_inc_dec_r16(e, opcode >> 4, (opcode & 0x0F) == 0x03);
+        *t_cycles += 8;
+        return JIT_TRANSLATED;
+    case 0x2F: // CPL
+        emit_load8(e, X86_AL, OFF_A);
+        emit8(e, 0xF6); // not al
+        emit8(e, 0xD0);
+        emit_store8(e, X86_AL, OFF_A);
+        emit_store_imm8(e, OFF_N, 1);
+        emit_store_imm8(e, OFF_H, 1);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    case 0x37: // SCF
+        emit_store_imm8(e, OFF_N, 0);
+        emit_store_imm8(e, OFF_H, 0);
+        emit_store_imm8(e, OFF_C, 1);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    case 0x3F: // CCF
+        emit_store_imm8(e, OFF_N, 0);
+        emit_store_imm8(e, OFF_H, 0);
+        emit8(e, 0x80); // xor byte [rbx + C], 1
+        emit_rbx(e, 6, OFF_C);
+        emit8(e, 1);
+        *t_cycles += 4;
+        return JIT_TRANSLATED;
+    case 0x18: // JR e8
+        emit_exit(e, pc + 2 + (__int8_t)n8, *t_cycles + 12);
+        *t_cycles += 12;
+        *length = 2;
+        return JIT_END_OF_BLOCK;
+    case 0x20: // JR NZ, e8
+    case 0x28: // JR Z, e8
+    case 0x30: // JR NC, e8
+    case 0x38: // JR C, e8
+        emit_branch_exit(e, opcode < 0x30 ? OFF_Z : OFF_C, opcode & 0x08,
+                         pc + 2 + (__int8_t)n8, *t_cycles + 12,
+                         pc + 2, *t_cycles + 8);
+        *t_cycles += 8;
+        *length = 2;
+        return JIT_END_OF_BLOCK;
+    case 0xC3: // JP a16
+        emit_exit(e, n16, *t_cycles + 16);
+        *t_cycles += 16;
+        *length = 3;
+        return JIT_END_OF_BLOCK;
+    case 0xC2: // JP NZ, a16
+    case 0xCA: // JP Z, a16
+    case 0xD2: // JP NC, a16
+    case 0xDA: // JP C, a16
+        emit_branch_exit(e, opcode < 0xD0 ? OFF_Z : OFF_C, opcode & 0x08,
+                         n16, *t_cycles + 16,
+                         pc + 3, *t_cycles + 12);
+        *t_cycles += 12;
+        *length = 3;
+        return JIT_END_OF_BLOCK;
+    default:
+        return JIT_UNSUPPORTED;
+    }
+}
+
+static void *alloc_code(void)
+{
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return code == MAP_FAILED ? NULL : code;
+}
+
+#else
+
+static int translate(Emitter *e, CPU *cpu, __uint16_t pc, __uint32_t *t_cycles, __uint8_t *length)
+{
+    return JIT_UNSUPPORTED;
+}
+
+static void emit_prologue(Emitter *e) {}
+static void emit_exit(Emitter *e, __uint16_t pc, __uint32_t t_cycles) {}
+static void emit_limit_check(Emitter *e, __uint16_t next_pc, __uint32_t t_cycles) {}
+
+static void *alloc_code(void)
+{
+    printf("JIT requires an x86-64 host, using the interpreter\n");
+    return NULL;
+}
+
+#endif
+
+// 0: fixed ROM bank, 1: switchable ROM bank, 2: RAM
+static __uint8_t region(__uint16_t address)
+{
+    return address < 0x4000 ? 0 : address < 0x8000 ? 1 : 2;
+}
+
+static __uint8_t block_bank(CPU *cpu, __uint16_t pc)
+{
+    if (region(pc) == 1 && cpu->cartridge->type == MBC1)
+        return cpu->cartridge->rom_bank;
+    return 0;
+}
+
+static void jit_flush(Jit *jit)
+{
+    for (int i = 0; i < 0x10000; i++)
+    {
+        while (jit->blocks[i])
+        {
+            JitBlock *block = jit->blocks[i];
+            jit->blocks[i] = block->next;
+            free(block);
+        }
+    }
+    jit->code_used = 0;
+    jit->extent_count = 0;
+}
+
+// Frees a block already unlinked from jit->blocks, keeping its code space
+static void release_block(Jit *jit, JitBlock *block)
+{
+    if (block->code)
+    {
+        if (jit->extent_count == jit->extent_capacity)
+        {
+            jit->extent_capacity = jit->extent_capacity ? jit->extent_capacity * 2 : 64;
+            jit->extents = realloc(jit->extents, jit->extent_capacity * sizeof(JitExtent));
+        }
+        jit->extents[jit->extent_count++] = (JitExtent){(__uint8_t *)block->code - jit->code, block->code_size};
+    }
+    free(block);
+}
+
+// First fit in the space of released blocks, NULL when none is big enough
+static __uint8_t *reuse_code(Jit *jit, size_t size)
+{
+    for (size_t i = 0; i < jit->extent_count; i++)
+    {
+        JitExtent *extent = &jit->extents[i];
+        if (extent->size < size)
+            continue;
+        __uint8_t *code = jit->code + extent->start;
+        extent->start += size;
+        extent->size -= size;
+        if (extent->size == 0)
+            *extent = jit->extents[--jit->extent_count];
+        return code;
+    }
+    return NULL;
+}
+
+static JitBlock *compile_block(Jit *jit, CPU *cpu, __uint16_t pc, __uint8_t bank)
+{
+    JitBlock *block = calloc(1, sizeof(JitBlock));
+    block->pc = pc;
+    block->bank = bank;
+
+    if (jit->code_used + JIT_BLOCK_CODE_MAX > JIT_CODE_SIZE)
+    {
+        jit_flush(jit);
+        jit->flushes++;
+    }
+
+    __uint8_t *start = jit->code + jit->code_used;
+    Emitter e = {start};
+    __uint16_t address = pc;
+    __uint32_t t_cycles = 0;
+    int result = JIT_TRANSLATED;
+
+    emit_prologue(&e);
+    while (block->instructions < JIT_MAX_INSTRUCTIONS && result == JIT_TRANSLATED)
+    {
+        if (region(address) != region(pc) || region(address + 2) != region(pc))
+            break;
+
+        __uint8_t length = 0;
+        __uint32_t start_cycles = t_cycles;
+        result = translate(&e, cpu, address, &t_cycles, &length);
+        if (result == JIT_UNSUPPORTED)
+            break;
+        for (int i = 0; i < length; i++)
+            block->source[block->length++] = read_memory(cpu, address + i);
+        address += length;
+        block->cycles[block->instructions++] = t_cycles - start_cycles;
+        if (result == JIT_TRANSLATED)
+            emit_limit_check(&e, address, t_cycles);
+    }
+
+    if (block->instructions == 0)
+        return block;
+
+    if (result != JIT_END_OF_BLOCK)
+        emit_exit(&e, address, t_cycles);
+    // Blocks only jump within themselves, so the code can move
+    block->code_size = e.p - start;
+    __uint8_t *code = reuse_code(jit, block->code_size);
+    if (code)
+    {
+        memcpy(code, start, block->code_size);
+        jit->code_reused++;
+    }
+    else
+    {
+        code = start;
+        jit->code_used += block->code_size;
+    }
+    block->code = (JitCode)code;
+    jit->blocks_compiled++;
+    return block;
+}
+
+static bool source_changed(CPU *cpu, JitBlock *block)
+{
+    for (int i = 0; i < block->length; i++)
+    {
+        if (read_memory(cpu, block->pc + i) != block->source[i])
+            return true;
+    }
+    return false;
+}
+
+static JitBlock *lookup_block(Jit *jit, CPU *cpu)
+{
+    __uint16_t pc = cpu->PC;
+    __uint8_t bank = block_bank(cpu, pc);
+    JitBlock **link = &jit->blocks[pc];
+
+    while (*link && (*link)->bank != bank)
+        link = &(*link)->next;
+    JitBlock *block = *link;
+    if (block)
+    {
+        if (region(pc) != 2 || !source_changed(cpu, block))
+            return block;
+        jit->invalidations++;
+        // Unlinked first: compiling may flush every block
+        *link = block->next;
+        release_block(jit, block);
+    }
+    block = compile_block(jit, cpu, pc, bank);
+    block->next = jit->blocks[pc];
+    jit->blocks[pc] = block;
+    return block;
+}
+
+static void run_reference(Jit *jit, CPU *cpu, JitBlock *block)
+{
+    CPU *shadow = jit->shadow;
+    Host host = CPU_host(cpu);
+    Host silent = CPU_silent_host(&host);
+
+    memcpy(shadow, cpu, sizeof(CPU));
+    *jit->shadow_fetcher = *cpu->fetcher;
+    silent.fetcher = jit->shadow_fetcher;
+    silent.jit = NULL;
+    silent.skip_pixels = host.skip_pixels; // the PPU state is compared
+    CPU_set_host(shadow, &silent);
+    for (int i = 0; i < block->instructions; i++)
+    {
+        exec_opcode(shadow);
+        if (handle_interrupts(shadow))
+            break;
+    }
+}
+
+static bool report_mismatch(Jit *jit, JitBlock *block, bool equal)
+{
+    if (equal && jit->mismatches < 10)
+        printf("JIT block %02X:%04X (%d instructions) differs from the interpreter:\n",
+               block->bank, block->pc, block->instructions);
+    return jit->mismatches < 10;
+}
+
+#define COMPARE(field)                                                                    \
+    if (cpu->field != shadow->field)                                                      \
+    {                                                                                     \
+        if (report_mismatch(jit, block, equal))                                           \
+            printf("  " #field ": jit=%X interpreter=%X\n", cpu->field, shadow->field);   \
+        equal = false;                                                                    \
+    }
+
+static void compare_reference(Jit *jit, CPU *cpu, JitBlock *block)
+{
+    CPU *shadow = jit->shadow;
+    bool equal = true;
+
+    COMPARE(PC);
+    COMPARE(SP);
+    COMPARE(registers.A);
+    COMPARE(registers.B);
+    COMPARE(registers.C);
+    COMPARE(registers.D);
+    COMPARE(registers.E);
+    COMPARE(registers.H);
+    COMPARE(registers.L);
+    COMPARE(Z);
+    COMPARE(N);
+    COMPARE(H);
+    COMPARE(C);
+    COMPARE(IME);
+    COMPARE(div_cycles);
+    COMPARE(tima_cycles);
+    if (memcmp(cpu->memory, shadow->memory, sizeof(cpu->memory)) != 0)
+    {
+        if (report_mismatch(jit, block, equal))
+            printf("  memory differs\n");
+        equal = false;
+    }
+    if (memcmp(&cpu->ppu, &shadow->ppu, sizeof(cpu->ppu)) != 0 ||
+        memcmp(cpu->fetcher, shadow->fetcher, sizeof(Fetcher)) != 0)
+    {
+        if (report_mismatch(jit, block, equal))
+            printf("  PPU state differs\n");
+        equal = false;
+    }
+    if (equal)
+        return;
+
+    // Continue from the interpreter's state so one divergence doesn't cascade
+    jit->mismatches++;
+    Host host = CPU_host(cpu);
+
+    memcpy(cpu, shadow, sizeof(CPU));
+    *host.fetcher = *shadow->fetcher;
+    CPU_set_host(cpu, &host);
+}
+
+Jit *jit_init(bool diff)
+{
+    Jit *jit = calloc(1, sizeof(Jit));
+    jit->code = alloc_code();
+    if (jit->code == NULL)
+    {
+        free(jit);
+        return NULL;
+    }
+    jit->diff = diff;
+    if (diff)
+    {
+        jit->shadow = malloc(sizeof(CPU));
+        jit->shadow_fetcher = malloc(sizeof(Fetcher));
+    }
+    return jit;
+}
+
+void jit_free(Jit *jit)
+{
+    if (jit == NULL)
+        return;
+    jit_flush(jit);
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit->extents);
+    free(jit->shadow);
+    free(jit->shadow_fetcher);
+    free(jit);
+}
+
+void jit_step(CPU *cpu)
+{
+    Jit *jit = cpu->jit;
+
+    // A pending EI must take effect after exactly one instruction. Blocks
+    // can't record a trace per instruction, so tracing interprets. OAM DMA
+    // ticks once per CPU_start iteration, so while it runs so do we.
+    if (cpu->ime_delay || cpu->trace || cpu->dma_cycles)
+    {
+        jit->interpreted_instructions++;
+        CPU_step(cpu);
+        return;
+    }
+
+    JitBlock *block = lookup_block(jit, cpu);
+    if (block->code == NULL)
+    {
+        jit->interpreted_instructions++;
+        CPU_step(cpu);
+        return;
+    }
+
+    if (jit->diff)
+        run_reference(jit, cpu, block);
+
+    __uint32_t limit = block->instructions;
+    __uint32_t ticked = 0;
+    if (cpu->IME)
+    {
+        for (int i = 0; i < block->instructions; i++)
+        {
+            for (int c = 0; c < block->cycles[i]; c += 4)
+                update_timer(cpu, 4);
+            ticked += block->cycles[i];
+            if (interrupt_pending(cpu))
+            {
+                limit = i + 1;
+                break;
+            }
+        }
+    }
+
+    __uint32_t t_cycles = block->code(cpu, limit);
+    for (; ticked < t_cycles; ticked += 4)
+        update_timer(cpu, 4);
+    handle_interrupts(cpu);
+
+    if (jit->diff)
+        compare_reference(jit, cpu, block);
+
+    jit->blocks_run++;
+    jit->jitted_instructions += limit;
+}
+
+void jit_report(Jit *jit, FILE *out)
+{
+    __uint64_t total = jit->jitted_instructions + jit->interpreted_instructions;
+
+    fprintf(out, "JIT: %lu blocks compiled (%lu into reclaimed code space), %lu blocks run, %lu invalidations, "
+                 "%lu flushes\n",
+            jit->blocks_compiled, jit->code_reused, jit->blocks_run, jit->invalidations, jit->flushes);
+    fprintf(out, "JIT: %lu of %lu instructions native (%.1f%%)\n",
+            jit->jitted_instructions, total, total ? 100.0 * jit->jitted_instructions / total : 0.0);
+    if (jit->diff)
+        fprintf(out, "JIT: %lu mismatches against the interpreter\n", jit->mismatches);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_INSTRUCTIONS 32
+#define JIT_MAX_BYTES (JIT_MAX_INSTRUCTIONS * 3)
+
+// Runs at most limit instructions, returns the T-cycles they took
+typedef __uint32_t (*JitCode)(CPU *cpu, __uint32_t limit);
+
+typedef struct JitBlock
+{
+    JitCode code; // NULL when the first instruction can't be translated
+    __uint32_t code_size;
+    struct JitBlock *next; // the block for another ROM bank at the same pc
+    __uint16_t pc;
+    __uint8_t bank;
+    __uint8_t length; // guest bytes covered by the block
+    __uint8_t instructions;
+    __uint8_t cycles[JIT_MAX_INSTRUCTIONS]; // per instruction, branches not taken
+    __uint8_t source[JIT_MAX_BYTES]; // guest bytes, checked for RAM blocks (self-modifying code)
+} JitBlock;
+
+// Code space left by an invalidated block, reused by the next blocks that fit
+typedef struct JitExtent
+{
+    size_t start;
+    size_t size;
+} JitExtent;
+
+typedef struct Jit
+{
+    JitBlock *blocks[0x10000]; // per pc, one per ROM bank
+    __uint8_t *code;
+    size_t code_used;
+    JitExtent *extents;
+    size_t extent_count;
+    size_t extent_capacity;
+    bool diff; // run every block on the interpreter as well and compare
+    CPU *shadow;
+    Fetcher *shadow_fetcher;
+    __uint64_t blocks_compiled;
+    __uint64_t blocks_run;
+    __uint64_t jitted_instructions;
+    __uint64_t interpreted_instructions;
+    __uint64_t invalidations;
+    __uint64_t code_reused; // blocks compiled into reclaimed code space
+    __uint64_t flushes;
+    __uint64_t mismatches;
+} Jit;
+
+Jit *jit_init(bool diff);
+void jit_free(Jit *jit);
+void jit_step(CPU *cpu);
+void jit_report(Jit *jit, FILE *out);
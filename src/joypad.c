@@ -1,64 +1,41 @@
 #include "joypad.h"
+#include "movie.h"
 
-void unset_bit(__uint8_t *byte, __uint8_t n)
-{
-    __uint8_t mask = ~(1u << n);
-    *byte &= mask;
-}
-
-void set_bit(__uint8_t *byte, __uint8_t n)
-{
-    __uint8_t mask = (1u << n);
-    *byte |= mask;
-}
+// Keys for cpu->buttons bits 0-7
+static const SDL_Scancode keys[8] = {
+    SDL_SCANCODE_RIGHT, SDL_SCANCODE_LEFT, SDL_SCANCODE_UP, SDL_SCANCODE_DOWN,
+    SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_SPACE, SDL_SCANCODE_RETURN};
 
 void update_joypad(CPU *cpu)
 {
-    const Uint8 *state = SDL_GetKeyboardState(NULL);
     __uint8_t selected = cpu->memory[IO_JOYPAD] & 0x30;
-    // printf("%.2x %.2x\n", selected, cpu->memory[IO_JOYPAD]);
     cpu->memory[IO_JOYPAD] |= 0x0F;
-    if (selected == SELECT_NONE)
-        return;
     if (selected == SELECT_BUTTONS)
-    {
-        if (state[SDL_SCANCODE_RIGHT])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 0);
-        }
-
-        if (state[SDL_SCANCODE_LEFT])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 1);
-        }
-        if (state[SDL_SCANCODE_UP])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 2);
-        }
-        if (state[SDL_SCANCODE_DOWN])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 3);
-        }
-    }
+        cpu->memory[IO_JOYPAD] &= ~(cpu->buttons & 0x0F);
     if (selected == SELECT_DPAD)
+        cpu->memory[IO_JOYPAD] &= ~(cpu->buttons >> 4);
+}
+
+__uint8_t joypad_keyboard(void)
+{
+    const Uint8 *state = SDL_GetKeyboardState(NULL);
+    __uint8_t held = 0;
+
+    for (int i = 0; state && i < 8; i++)
     {
-        if (state[SDL_SCANCODE_Z])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 0);
-        }
-        if (state[SDL_SCANCODE_X])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 1);
-        }
-        if (state[SDL_SCANCODE_SPACE])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 2);
-        }
-        if (state[SDL_SCANCODE_RETURN])
-        {
-            unset_bit(&cpu->memory[IO_JOYPAD], 3);
-        }
+        if (state[keys[i]])
+            held |= 1 << i;
     }
+    return held;
+}
 
-    // printf("%.2x\n", cpu->memory[IO_JOYPAD]);
-}
\ No newline at end of file
+// Samples input once per frame, at the frame boundary, so input is a pure
+// function of the frame number and a movie can replay it exactly. The
+// keyboard belongs to the machine with the window. One without takes
+// cpu->host_buttons: what run-ahead sampled for its hidden real frame,
+// nothing for player 2 of a link, who only gets input from its movie.
+void joypad_frame(CPU *cpu)
+{
+    __uint8_t live = cpu->display ? joypad_keyboard() : cpu->host_buttons;
+    cpu->buttons = cpu->movie ? movie_frame(cpu->movie, live) : live;
+}
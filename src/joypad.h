@@ -7,5 +7,16 @@
 #define SELECT_BUTTONS 0x20
 #define SELECT_NONE 0x30
 #define IO_JOYPAD 0xFF00
+#define BUTTON_RIGHT 0x01 // cpu->buttons, set while held
+#define BUTTON_LEFT 0x02
+#define BUTTON_UP 0x04
+#define BUTTON_DOWN 0x08
+#define BUTTON_A 0x10
+#define BUTTON_B 0x20
+#define BUTTON_SELECT 0x40
+#define BUTTON_START 0x80
 
-void update_joypad(CPU *cpu);
\ No newline at end of file
+void update_joypad(CPU *cpu);
+// Keys held on the keyboard now, as BUTTON_* bits
+__uint8_t joypad_keyboard(void);
+void joypad_frame(CPU *cpu);
\ No newline at end of file
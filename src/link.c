@@ -0,0 +1,74 @@
+#include "link.h"
+#include "movie.h"
+#include "state.h"
+
+Link *link_open(CPU *cpu, const char *filename)
+{
+    Link *link = calloc(1, sizeof(Link));
+    CPU *player2 = calloc(1, sizeof(CPU));
+
+    CPU_init(player2, calloc(1, sizeof(Fetcher)), filename, NULL);
+    if (cpu->serial == NULL)
+        cpu->serial = serial_init(cpu);
+    player2->serial = serial_init(player2);
+    serial_link_local(cpu->serial, player2->serial);
+    link->players[0] = cpu;
+    link->players[1] = player2;
+    return link;
+}
+
+// How far the other machine may run ahead of cpu
+static __uint64_t run_limit(CPU *cpu)
+{
+    __uint64_t limit = cpu->cycles + LINK_SKEW_CYCLES;
+
+    // A transfer cpu clocked ends at a known cycle
+    if ((cpu->memory[SC] & 0x81) == 0x81 && cpu->serial_cycles && cpu->cycles + cpu->serial_cycles < limit)
+        limit = cpu->cycles + cpu->serial_cycles;
+    return limit;
+}
+
+void link_run(Link *link, SDL_Event *e)
+{
+    CPU *player1 = link->players[0];
+    bool quit = false;
+
+    while (!quit && !(player1->frame_limit && player1->frames >= player1->frame_limit))
+    {
+        // Whichever is behind runs until it is LINK_SKEW_CYCLES ahead, or
+        // to where the other's transfer ends
+        int behind = link->players[1]->cycles < player1->cycles;
+        CPU *cpu = link->players[behind];
+        cpu->cycle_limit = run_limit(link->players[!behind]);
+        CPU_start(cpu, NULL);
+        link->slices++;
+        while (e && SDL_PollEvent(e) != 0)
+        {
+            if (e->type == SDL_QUIT)
+                quit = true;
+        }
+    }
+    link->players[0]->cycle_limit = link->players[1]->cycle_limit = 0;
+}
+
+void link_report(Link *link, FILE *out)
+{
+    CPU *player2 = link->players[1];
+    Serial *serial = player2->serial;
+
+    fprintf(out, "Two-player link: %lu slices with at most %d T-cycles between the players\n", link->slices, LINK_SKEW_CYCLES);
+    fprintf(out, "Player 2: %lu frames, %lu transfers clocked, %lu received, frame hash %016lx\n", player2->frames,
+            serial->clocked, serial->received, state_frame_hash(player2));
+}
+
+void link_close(Link *link)
+{
+    CPU *player2 = link->players[1];
+
+    if (player2->movie)
+        movie_close(player2->movie);
+    serial_free(player2->serial);
+    free(player2->fetcher);
+    free(player2);
+    free(link);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdio.h>
+#include "cpu.h"
+#include "serial.h"
+// How far one machine may run ahead of the other. A transfer takes this
+// long, so one a machine starts can't end before the other has got to it.
+// While the other has a transfer of its own on the way, a machine only
+// runs up to where that one ends. So when a transfer ends, the other
+// machine is never past that point, and serial catches it up to the exact
+// cycle. The pair only synchronizes at transfers and still exchanges every
+// byte as a real cable would, give or take the last instruction.
+#define LINK_SKEW_CYCLES SERIAL_TRANSFER_CYCLES
+
+// Two machines in one process connected by a link cable, for multiplayer
+// games. Player 2 runs headless; its input comes from a movie, if any.
+typedef struct Link
+{
+    CPU *players[2]; // players[1] belongs to the link
+    __uint64_t slices; // CPU_start calls
+} Link;
+
+Link *link_open(CPU *cpu, const char *filename);
+// Runs both machines in bounded-skew lockstep until the window is closed or
+// player 1 reaches its frame_limit
+void link_run(Link *link, SDL_Event *e);
+void link_report(Link *link, FILE *out);
+void link_close(Link *link);
@@ -1,34 +1,385 @@
+#include <string.h>
 #include "cpu.h"
 #include "ppu.h"
+#include "jit.h"
+#include "recomp.h"
+#include "fusion.h"
+#include "sampler.h"
+#include "callstack.h"
+#include "trace.h"
+#include "pacing.h"
+#include "display.h"
+#include "audio.h"
+#include "capture.h"
+#include "recorder.h"
+#include "movie.h"
+#include "state.h"
+#include "serial.h"
+#include "link.h"
+#include "rollback.h"
+#include "runahead.h"
+#include "bench.h"
 
 int main(int argc, char **argv)
 {
-    if (argc < 2)
+    const char *filename = NULL;
+    bool jit = false;
+    bool jit_diff = false;
+    bool fuse = false;
+    const char *pairs_path = NULL;
+    __uint64_t sample_cycles = 0;
+    long sample_usec = 0;
+    const char *sym_path = NULL;
+    const char *trace_path = NULL;
+    bool unthrottled = false;
+    bool vsync = false;
+    bool sync_render = false;
+    bool no_audio = false;
+    bool audio_sync = false;
+    bool headless = false;
+    __uint64_t frame_limit = 0;
+    const char *capture_path = NULL;
+    bool audio_checksum = false;
+    const char *record_path = NULL;
+    const char *load_state = NULL;
+    const char *save_state = NULL;
+    const char *record_movie = NULL;
+    const char *play_movie = NULL;
+    bool bench = false;
+    bool serial_echo = false;
+    const char *link_listen = NULL;
+    const char *link_connect = NULL;
+    const char *link_rom = NULL;
+    const char *link_movie = NULL;
+    const char *rollback_path = NULL;
+    int rollback_frames = ROLLBACK_DEFAULT_FRAMES;
+    int run_ahead = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else if (strcmp(argv[i], "--jit-diff") == 0)
+            jit = jit_diff = true;
+        else if (strcmp(argv[i], "--fuse") == 0)
+            fuse = true;
+        else if (strcmp(argv[i], "--dump-pairs") == 0 && i + 1 < argc)
+            pairs_path = argv[++i];
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+            sample_cycles = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--sample-timer") == 0 && i + 1 < argc)
+            sample_usec = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--sym") == 0 && i + 1 < argc)
+            sym_path = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (strcmp(argv[i], "--unthrottled") == 0)
+            unthrottled = true;
+        else if (strcmp(argv[i], "--vsync") == 0)
+            vsync = true;
+        else if (strcmp(argv[i], "--sync-render") == 0)
+            sync_render = true;
+        else if (strcmp(argv[i], "--no-audio") == 0)
+            no_audio = true;
+        else if (strcmp(argv[i], "--audio-sync") == 0)
+            audio_sync = true;
+        else if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frame_limit = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--capture-audio") == 0 && i + 1 < argc)
+            capture_path = argv[++i];
+        else if (strcmp(argv[i], "--audio-checksum") == 0)
+            audio_checksum = true;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+            load_state = argv[++i];
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+            save_state = argv[++i];
+        else if (strcmp(argv[i], "--record-movie") == 0 && i + 1 < argc)
+            record_movie = argv[++i];
+        else if (strcmp(argv[i], "--play-movie") == 0 && i + 1 < argc)
+            play_movie = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0)
+            bench = headless = true;
+        else if (strcmp(argv[i], "--serial") == 0)
+            serial_echo = true;
+        else if (strcmp(argv[i], "--link-listen") == 0 && i + 1 < argc)
+            link_listen = argv[++i];
+        else if (strcmp(argv[i], "--link-connect") == 0 && i + 1 < argc)
+            link_connect = argv[++i];
+        else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc)
+            link_rom = argv[++i];
+        else if (strcmp(argv[i], "--link-movie") == 0 && i + 1 < argc)
+            link_movie = argv[++i];
+        else if (strcmp(argv[i], "--rollback") == 0 && i + 1 < argc)
+            rollback_path = argv[++i];
+        else if (strcmp(argv[i], "--rollback-frames") == 0 && i + 1 < argc)
+            rollback_frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc)
+            run_ahead = atoi(argv[++i]);
+        else
+            filename = argv[i];
+    }
+    if (filename == NULL)
     {
         printf("Provide ROM path\n");
         exit(1);
     }
-    const char *filename = argv[1];
-    FILE *file = fopen("output.txt", "w");
-    SDL_Window *window = SDL_Window_init();
-    SDL_Renderer *renderer = SDL_Renderer_init(window);
-    SDL_Event e;
-
-    if (file == NULL)
+    if (link_rom && (link_listen || link_connect || bench || recomp_run))
+    {
+        printf("--link can't be combined with a socket link, --bench or a native build\n");
+        exit(1);
+    }
+    if (rollback_path && (link_rom || link_listen || link_connect || bench || play_movie || record_movie))
+    {
+        printf("--rollback can't be combined with a link, --bench or movies\n");
+        exit(1);
+    }
+    if (rollback_frames < 0 || rollback_frames > ROLLBACK_MAX_FRAMES)
+    {
+        printf("--rollback-frames takes 0 to %d\n", ROLLBACK_MAX_FRAMES);
+        exit(1);
+    }
+    if (run_ahead < 0 || run_ahead > RUNAHEAD_MAX_FRAMES)
+    {
+        printf("--run-ahead takes 0 to %d\n", RUNAHEAD_MAX_FRAMES);
+        exit(1);
+    }
+    if (run_ahead && (link_rom || link_listen || link_connect || rollback_path || bench || recomp_run))
+    {
+        printf("--run-ahead can't be combined with a link, --rollback, --bench or a native build\n");
+        exit(1);
+    }
+#ifndef TRACE
+    if (trace_path)
     {
-        perror("Error opening file");
-        return 1;
+        printf("--trace needs a TRACE build (make TRACE=1)\n");
+        exit(1);
     }
+#endif
+    if (headless)
+        no_audio = unthrottled = true;
+    SDL_Window *window = headless ? NULL : SDL_Window_init();
+    Display *display = window ? display_init(window, vsync, !sync_render) : NULL;
+    SDL_Event e;
 
     CPU cpu = {0};
     Fetcher fetcher = {0};
 
-    CPU_init(&cpu, &fetcher, filename, window, renderer, file);
-    CPU_start(&cpu, &e, file);
+    CPU_init(&cpu, &fetcher, filename, display);
+    if (load_state)
+        state_load_file(&cpu, load_state);
+    if (play_movie)
+        cpu.movie = movie_play(&cpu, play_movie);
+    else if (record_movie)
+        cpu.movie = movie_record(&cpu, record_movie, load_state != NULL);
+    // Headless playback ends with the movie
+    if (frame_limit == 0 && play_movie && headless)
+        frame_limit = cpu.movie->length;
+    if (frame_limit == 0 && bench)
+        frame_limit = BENCH_DEFAULT_FRAMES;
+    if (frame_limit)
+        cpu.frame_limit = cpu.frames + frame_limit;
+    Rollback *rollback = rollback_path ? rollback_connect(&cpu, rollback_path, rollback_frames) : NULL;
+    RunAhead *runahead = run_ahead ? runahead_init(&cpu, run_ahead) : NULL;
+    if (capture_path || audio_checksum)
+        cpu.capture = capture_open(capture_path);
+    if (record_path)
+        cpu.recorder = recorder_open(record_path);
+    if (!no_audio)
+        cpu.audio = audio_init(audio_sync && !unthrottled);
+    if (trace_path)
+        trace_open(&cpu, trace_path);
+    if (serial_echo || link_listen || link_connect)
+    {
+        cpu.serial = serial_init(&cpu);
+        cpu.serial->echo = serial_echo;
+        if (link_listen)
+            serial_listen(cpu.serial, link_listen);
+        else if (link_connect)
+            serial_connect(cpu.serial, link_connect);
+    }
+    Link *link = NULL;
+    if (link_rom)
+    {
+        link = link_open(&cpu, link_rom);
+        if (link_movie)
+            link->players[1]->movie = movie_play(link->players[1], link_movie);
+    }
+    if (!unthrottled && !(cpu.audio && cpu.audio->sync))
+        cpu.pacer = pacer_init(vsync);
+    if (jit)
+        cpu.jit = jit_init(jit_diff);
+    if (fuse || pairs_path)
+        cpu.fusion = fusion_init(fuse, pairs_path != NULL);
+    Symbols *symbols = NULL;
+    if (sym_path)
+    {
+        symbols = symbols_load(sym_path);
+        if (symbols == NULL)
+        {
+            perror("Error opening symbol file");
+            return 1;
+        }
+    }
+    else
+        symbols = symbols_load_for_rom(filename);
+    if (sample_cycles || sample_usec > 0)
+        cpu.sampler = sampler_init(&cpu, sample_cycles, sample_usec, symbols);
+#ifdef CALLSTACK
+    cpu.callstack = callstack_init(&cpu);
+#endif
+    // With --bench stdout is the JSON result, the reports go to stderr
+    FILE *report = bench ? stderr : stdout;
+    if (bench)
+    {
+        BenchResult result = {.rom = filename};
+        result.engine = recomp_run ? "recomp" : cpu.jit ? "jit" : cpu.fusion && cpu.fusion->enabled ? "fuse" : "interpreter";
+        bench_run(&cpu, frame_limit, &result);
+        bench_write_json(&result, stdout);
+    }
+    else if (link)
+        link_run(link, &e);
+    else if (rollback)
+        rollback_run(rollback, &e);
+    else if (runahead)
+        runahead_run(runahead, &e);
+    else
+        CPU_start(&cpu, &e);
+    if (cpu.jit)
+    {
+        jit_report(cpu.jit, report);
+        jit_free(cpu.jit);
+    }
+    if (recomp_run)
+        recomp_report(report);
+    if (cpu.fusion)
+    {
+        fusion_report(cpu.fusion, report);
+        if (pairs_path)
+        {
+            FILE *pairs = fopen(pairs_path, "w");
+            if (pairs == NULL)
+                perror("Error opening pair histogram file");
+            else
+            {
+                fusion_dump_pairs(cpu.fusion, pairs);
+                fclose(pairs);
+            }
+        }
+        fusion_free(cpu.fusion);
+    }
+    if (cpu.sampler)
+    {
+        FILE *hotspots = fopen(SAMPLER_REPORT, "w");
+        FILE *folded = fopen(SAMPLER_FOLDED, "w");
+        if (hotspots == NULL || folded == NULL)
+            perror("Error opening hotspot report");
+        else
+        {
+            sampler_report(cpu.sampler, hotspots, folded);
+            fprintf(report, "Hotspots written to %s and %s\n", SAMPLER_REPORT, SAMPLER_FOLDED);
+        }
+        if (hotspots)
+            fclose(hotspots);
+        if (folded)
+            fclose(folded);
+        sampler_free(cpu.sampler);
+    }
+    if (cpu.callstack)
+    {
+        FILE *folded = fopen(CALLSTACK_OUTPUT, "w");
+        if (folded == NULL)
+            perror("Error opening call stack output");
+        else
+        {
+            callstack_report(&cpu, symbols, folded);
+            fclose(folded);
+            fprintf(report, "Call stack: %lu unmatched returns, %lu calls past depth %d, written to %s\n",
+                    cpu.callstack->unmatched_returns, cpu.callstack->dropped_calls, CALLSTACK_MAX_DEPTH,
+                    CALLSTACK_OUTPUT);
+        }
+        callstack_free(cpu.callstack);
+    }
+    symbols_free(symbols);
 
-    fclose(file);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (cpu.pacer)
+    {
+        pacer_report(cpu.pacer, report);
+        free(cpu.pacer);
+    }
+    if (cpu.trace)
+    {
+        fprintf(report, "Trace: %lu records, emulation waited on the writer %lu times\n",
+                cpu.trace->records, cpu.trace->stalls);
+        trace_close(cpu.trace);
+    }
+    if (cpu.capture)
+    {
+        Capture *capture = cpu.capture;
+        capture_close(capture);
+        fprintf(report, "Audio capture: %lu frames (%.2f s), checksum %016lx", capture->frames,
+                (double)capture->frames / APU_SAMPLE_RATE, capture->checksum);
+        if (capture_path)
+            fprintf(report, ", written to %s", capture_path);
+        fprintf(report, ", emulation waited on the writer %lu times\n", capture->stalls);
+        free(capture);
+    }
+    if (cpu.serial)
+    {
+        serial_report(cpu.serial, report);
+        serial_free(cpu.serial);
+    }
+    if (link)
+    {
+        link_report(link, report);
+        link_close(link);
+    }
+    if (rollback)
+    {
+        rollback_report(rollback, report);
+        rollback_close(rollback);
+    }
+    if (runahead)
+    {
+        runahead_report(runahead, report);
+        runahead_free(runahead);
+    }
+    if (save_state)
+        state_save_file(&cpu, save_state);
+    if (cpu.movie)
+    {
+        Movie *movie = cpu.movie;
+        if (movie->recording)
+            fprintf(report, "Movie: %lu frames recorded to %s", movie->length, movie->path);
+        else
+            fprintf(report, "Movie: %lu of %lu frames played from %s", movie->position, movie->length, movie->path);
+        fprintf(report, ", final frame hash %016lx\n", state_frame_hash(&cpu));
+        movie_close(movie);
+    }
+    if (cpu.recorder)
+    {
+        Recorder *recorder = cpu.recorder;
+        recorder_close(recorder);
+        fprintf(report, "Recording: %lu frames as %lu %s written to %s, emulation waited on the encoder %lu times\n",
+                recorder->frames, recorder->written, recorder->gif ? "GIF images" : "Y4M frames", record_path,
+                recorder->stalls);
+        free(recorder);
+    }
+    if (cpu.audio)
+    {
+        audio_report(cpu.audio, report);
+        audio_free(cpu.audio);
+    }
+    if (display)
+    {
+        display_report(display, report);
+        display_free(display);
+    }
+    if (window)
+        SDL_DestroyWindow(window);
     SDL_Quit();
 
     return 0;
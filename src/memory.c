@@ -1,6 +1,16 @@
 #include "memory.h"
 #include "cpu.h"
 #include "timer.h"
+#include "sections.h"
+#include "serial.h"
+
+#ifdef SECTIONS
+// The accessors below are the untimed ones; the timed wrappers at the end
+// of the file take their public names. Opcode fetches stay untimed and
+// count as cpu.
+#define read_memory read_memory_untimed
+#define write_memory write_memory_untimed
+#endif
 
 Cartridge *load_cartridge(const char *rom_path)
 {
@@ -91,6 +101,16 @@ Cartridge *load_cartridge(const char *rom_path)
     return cart;
 }
 
+// ROM bank mapped at address, 0 outside the switchable 0x4000-0x7FFF window
+__uint8_t rom_bank_at(Cartridge *cart, uint16_t address)
+{
+    if (address < 0x4000 || address >= 0x8000)
+        return 0;
+    if (cart->type == MBC1)
+        return cart->rom_bank % (cart->rom_size / 0x4000);
+    return 1;
+}
+
 void write_memory(CPU *cpu, uint16_t address, uint8_t value)
 {
     Cartridge *cartridge = cpu->cartridge;
@@ -149,6 +169,10 @@ void write_memory(CPU *cpu, uint16_t address, uint8_t value)
         cpu->memory[address] = value;
         update_dma(cpu);
     }
+    else if (address == SB || address == SC)
+    {
+        serial_write(cpu, address, value);
+    }
     else if (address == IO_JOYPAD)
     {
         cpu->memory[address] = (value | 0x0F);
@@ -158,6 +182,10 @@ void write_memory(CPU *cpu, uint16_t address, uint8_t value)
         cpu->div_cycles = 0;
         cpu->memory[DIV] = 0;
     }
+    else if (address >= NR10 && address < WAVE_RAM + 16)
+    {
+        apu_write(cpu, address, value);
+    }
     else
     {
         cpu->memory[address] = value;
@@ -199,6 +227,10 @@ __uint8_t read_memory(CPU *cpu, uint16_t address)
             return cart->ram_data[address - 0xA000]; // ROM only
         }
     }
+    else if (address >= NR10 && address < WAVE_RAM)
+    {
+        return apu_read(cpu, address);
+    }
     else
     {
         return cpu->memory[address];
@@ -208,4 +240,24 @@ __uint8_t read_memory(CPU *cpu, uint16_t address)
 __uint8_t read_opcode(CPU *cpu)
 {
     return read_memory(cpu, cpu->PC++);
-}
\ No newline at end of file
+}
+
+#ifdef SECTIONS
+#undef read_memory
+#undef write_memory
+
+__uint8_t read_memory(CPU *cpu, uint16_t address)
+{
+    SECTION_ENTER(SECTION_MEMORY);
+    __uint8_t value = read_memory_untimed(cpu, address);
+    SECTION_LEAVE();
+    return value;
+}
+
+void write_memory(CPU *cpu, uint16_t address, uint8_t value)
+{
+    SECTION_ENTER(SECTION_MEMORY);
+    write_memory_untimed(cpu, address, value);
+    SECTION_LEAVE();
+}
+#endif
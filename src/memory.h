@@ -17,6 +17,7 @@ typedef struct Cartridge
 {
     __uint8_t *rom_data;
     size_t rom_size;
+    __uint64_t rom_hash; // state_rom_hash, 0 until first needed
 
     __uint8_t *ram_data;
     size_t ram_size;
@@ -33,4 +34,5 @@ typedef struct Cartridge
 __uint8_t read_memory(CPU *cpu, uint16_t address);
 void write_memory(CPU *cpu, uint16_t address, uint8_t value);
 __uint8_t read_opcode(CPU *cpu);
-Cartridge *load_cartridge(const char *rom_path);
\ No newline at end of file
+Cartridge *load_cartridge(const char *rom_path);
+__uint8_t rom_bank_at(Cartridge *cart, uint16_t address);
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include "movie.h"
+#include "state.h"
+
+// Input is only sampled at frame boundaries (joypad_frame), so one byte
+// per frame is the whole input and the run-length coding makes a typical
+// movie a few bytes per second of play.
+
+static void put_u64(FILE *file, __uint64_t value)
+{
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static __uint64_t get_u64(const __uint8_t **in)
+{
+    __uint64_t value;
+    memcpy(&value, *in, sizeof(value));
+    *in += sizeof(value);
+    return value;
+}
+
+Movie *movie_record(CPU *cpu, const char *path, bool with_state)
+{
+    Movie *movie = calloc(1, sizeof(Movie));
+    movie->path = path;
+    movie->recording = true;
+    movie->rom_hash = state_rom_hash(cpu);
+    if (with_state)
+    {
+        movie->state_size = state_size(cpu);
+        movie->state = malloc(movie->state_size);
+        state_save(cpu, movie->state);
+    }
+    // Fail now rather than after the play session
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        perror("Error opening movie");
+        exit(1);
+    }
+    fclose(file);
+    return movie;
+}
+
+Movie *movie_play(CPU *cpu, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("Error opening movie");
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    __uint8_t *data = malloc(size);
+    size_t header = strlen(MOVIE_MAGIC) + 3 * sizeof(__uint64_t);
+    if (fread(data, 1, size, file) != (size_t)size || (size_t)size < header ||
+        memcmp(data, MOVIE_MAGIC, strlen(MOVIE_MAGIC)) != 0)
+    {
+        printf("%s is not a movie\n", path);
+        exit(1);
+    }
+    fclose(file);
+
+    Movie *movie = calloc(1, sizeof(Movie));
+    const __uint8_t *in = data + strlen(MOVIE_MAGIC);
+    const __uint8_t *end = data + size;
+    movie->path = path;
+    movie->rom_hash = get_u64(&in);
+    movie->length = get_u64(&in);
+    movie->state_size = get_u64(&in);
+    if (movie->rom_hash != state_rom_hash(cpu))
+    {
+        printf("%s was recorded on a different ROM\n", path);
+        exit(1);
+    }
+    if (movie->state_size)
+    {
+        if (movie->state_size > (size_t)(end - in) || !state_load(cpu, in, movie->state_size))
+        {
+            printf("%s starts from a save state this build can't load\n", path);
+            exit(1);
+        }
+        in += movie->state_size;
+    }
+
+    movie->inputs = malloc(movie->length ? movie->length : 1);
+    __uint64_t frame = 0;
+    while (frame < movie->length && in < end)
+    {
+        __uint8_t buttons = *in++;
+        __uint64_t run = 0;
+        for (int shift = 0; in < end; shift += 7)
+        {
+            run |= (__uint64_t)(*in & 0x7F) << shift;
+            if (!(*in++ & 0x80))
+                break;
+        }
+        if (run > movie->length - frame)
+            run = movie->length - frame;
+        memset(&movie->inputs[frame], buttons, run);
+        frame += run;
+    }
+    if (frame != movie->length)
+    {
+        printf("%s is truncated\n", path);
+        exit(1);
+    }
+    free(data);
+    return movie;
+}
+
+__uint8_t movie_frame(Movie *movie, __uint8_t live)
+{
+    if (!movie->recording)
+        return movie->position < movie->length ? movie->inputs[movie->position++] : live;
+
+    if (movie->length == movie->capacity)
+    {
+        movie->capacity = movie->capacity ? movie->capacity * 2 : 4096;
+        movie->inputs = realloc(movie->inputs, movie->capacity);
+    }
+    movie->inputs[movie->length++] = live;
+    return live;
+}
+
+bool movie_finished(Movie *movie)
+{
+    return !movie->recording && movie->position >= movie->length;
+}
+
+void movie_close(Movie *movie)
+{
+    if (movie == NULL)
+        return;
+    if (movie->recording)
+    {
+        FILE *file = fopen(movie->path, "wb");
+        if (file == NULL)
+        {
+            perror("Error opening movie");
+            exit(1);
+        }
+        fwrite(MOVIE_MAGIC, 1, strlen(MOVIE_MAGIC), file);
+        put_u64(file, movie->rom_hash);
+        put_u64(file, movie->length);
+        put_u64(file, movie->state_size);
+        if (movie->state_size)
+            fwrite(movie->state, 1, movie->state_size, file);
+        for (__uint64_t frame = 0; frame < movie->length;)
+        {
+            __uint8_t buttons = movie->inputs[frame];
+            __uint64_t run = 1;
+            while (frame + run < movie->length && movie->inputs[frame + run] == buttons)
+                run++;
+            fputc(buttons, file);
+            for (__uint64_t left = run; ; left >>= 7)
+            {
+                fputc((left & 0x7F) | (left >= 0x80 ? 0x80 : 0), file);
+                if (left < 0x80)
+                    break;
+            }
+            frame += run;
+        }
+        if (fclose(file) != 0)
+        {
+            perror("Error writing movie");
+            exit(1);
+        }
+    }
+    free(movie->inputs);
+    free(movie->state);
+    free(movie);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+#define MOVIE_MAGIC "GBMOVIE1"
+
+// Joypad input, one byte per frame (cpu->buttons), recorded from power on
+// or from a save state that is embedded in the movie. Played back on the
+// same ROM the frames come out identical.
+//
+// File: magic, ROM hash, frame count, state size (0 for power on), the
+// state, then runs of (buttons, LEB128 run length).
+typedef struct Movie
+{
+    const char *path;
+    bool recording;
+    __uint64_t rom_hash;
+    __uint8_t *inputs;
+    __uint64_t length;
+    __uint64_t capacity;
+    __uint64_t position; // next frame to play
+    __uint8_t *state;
+    size_t state_size;
+} Movie;
+
+// Starts recording; with_state embeds the current machine state as the
+// starting point, otherwise playback starts from power on
+Movie *movie_record(CPU *cpu, const char *path, bool with_state);
+// Loads a movie and puts the machine at its starting point
+Movie *movie_play(CPU *cpu, const char *path);
+// The buttons for the frame starting now, given what the keyboard holds
+__uint8_t movie_frame(Movie *movie, __uint8_t live);
+bool movie_finished(Movie *movie);
+// Writes a recording out, frees the movie
+void movie_close(Movie *movie);
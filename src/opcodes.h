@@ -0,0 +1,109 @@
+#pragma once
+#include "cpu.h"
+
+// Instruction handlers implemented in cpu.c. exec_opcode dispatches to these;
+// they are declared here for code that calls them directly, such as the
+// translation units generated by tools/recomp.c.
+
+__int16_t get_HL(CPU *cpu);
+__uint8_t get_F(CPU *cpu);
+__int16_t get_BC(CPU *cpu);
+__int16_t get_DE(CPU *cpu);
+__uint8_t PUSH_DE(CPU *cpu);
+__uint8_t PUSH_BC(CPU *cpu);
+__uint8_t PUSH_AF(CPU *cpu);
+__uint8_t PUSH_HL(CPU *cpu);
+__uint8_t RRA(CPU *cpu, __uint8_t *r8);
+__uint8_t RLCA(CPU *cpu);
+__uint8_t RLA(CPU *cpu);
+__uint8_t RRCA(CPU *cpu);
+__uint8_t DEC_r8(CPU *cpu, __uint8_t *r8);
+__uint8_t DEC_SP(CPU *cpu);
+__uint8_t INC_SP(CPU *cpu);
+__uint8_t INC_BC(CPU *cpu);
+__uint8_t INC_DE(CPU *cpu);
+__uint8_t INC_r8(CPU *cpu, __uint8_t *r8);
+__uint8_t INC_aHL(CPU *cpu);
+__uint8_t SUB_A_n8(CPU *cpu);
+__uint8_t SUB_A_HL(CPU *cpu);
+__uint8_t SUB_A_r8(CPU *cpu, __uint8_t value);
+__uint8_t INC_HL(CPU *cpu);
+__uint8_t LD_HLD_A(CPU *cpu);
+__uint8_t LD_HLI_A(CPU *cpu);
+__uint8_t LD_A_r16(CPU *cpu, __uint16_t address);
+__uint8_t LD_r16_A(CPU *cpu, __uint16_t address);
+__uint8_t LD_A_HLI(CPU *cpu);
+__uint8_t LD_A_HLD(CPU *cpu);
+__uint8_t DEC_HL_a16(CPU *cpu);
+__uint8_t DEC_HL_r16(CPU *cpu);
+__uint8_t DEC_BC(CPU *cpu);
+__uint8_t DEC_DE_r16(CPU *cpu);
+__uint8_t DAA(CPU *cpu);
+__uint8_t HALT(CPU *cpu);
+__uint8_t STOP(CPU *cpu);
+__uint8_t EI(CPU *cpu);
+__uint8_t DI(CPU *cpu);
+__uint8_t NOP(CPU *cpu);
+__uint8_t LD_r8_HL(CPU *cpu, __uint8_t *r8);
+__uint8_t LD_SP_HL(CPU *cpu);
+__uint8_t LD_SP_n16(CPU *cpu);
+__uint8_t LD_a16_SP(CPU *cpu);
+__uint8_t LD_r8_n8(CPU *cpu, __uint8_t *r8);
+__uint8_t LD_r8_r8(CPU *cpu, __uint8_t *r_dest, __uint8_t val);
+__uint8_t LD_A_a16(CPU *cpu);
+__uint8_t LD_a16_A(CPU *cpu);
+__uint8_t LD_a8_A(CPU *cpu);
+__uint8_t LD_A_a8(CPU *cpu);
+__uint8_t LD_A_C(CPU *cpu);
+__uint8_t LD_C_A(CPU *cpu);
+__uint8_t LD_BC_n16(CPU *cpu);
+__uint8_t LD_DE_n16(CPU *cpu);
+__uint8_t LD_HL_n16(CPU *cpu);
+__uint8_t LD_DE_A(CPU *cpu);
+__uint8_t LD_A_DE(CPU *cpu);
+__uint8_t XOR_A_r8(CPU *cpu, __uint8_t val);
+__uint8_t XOR_A_n8(CPU *cpu);
+__uint8_t XOR_A_HL(CPU *cpu);
+__uint8_t OR_A_r8(CPU *cpu, __uint8_t val);
+__uint8_t OR_A_n8(CPU *cpu);
+__uint8_t AND_A_n8(CPU *cpu);
+__uint8_t AND_A_HL(CPU *cpu);
+__uint8_t AND_A_r8(CPU *cpu, __uint8_t val);
+__uint8_t OR_A_HL(CPU *cpu);
+__uint8_t LD_HL_r8(CPU *cpu, __uint8_t r8);
+__uint8_t LD_HL_n8(CPU *cpu);
+__uint8_t POP_DE(CPU *cpu);
+__uint8_t POP_BC(CPU *cpu);
+__uint8_t POP_AF(CPU *cpu);
+__uint8_t POP_HL(CPU *cpu);
+__uint8_t ADC_A_r8(CPU *cpu, __uint8_t n8);
+__uint8_t ADC_A_n8(CPU *cpu);
+__uint8_t ADC_A_HL(CPU *cpu);
+__uint8_t SBC_A_r8(CPU *cpu, __uint8_t n8);
+__uint8_t SBC_A_n8(CPU *cpu);
+__uint8_t SBC_A_HL(CPU *cpu);
+__uint8_t ADD_HL_r16(CPU *cpu, __uint16_t r16);
+__uint8_t ADD_SP_s8(CPU *cpu);
+__uint8_t ADD_A_n8(CPU *cpu);
+__uint8_t ADD_A_HL(CPU *cpu);
+__uint8_t ADD_A_r8(CPU *cpu, __uint8_t value);
+__uint8_t LD_HL_SP_s8(CPU *cpu);
+__uint8_t CPL(CPU *cpu);
+__uint8_t SCF(CPU *cpu);
+__uint8_t CCF(CPU *cpu);
+__uint8_t CP_A_n8(CPU *cpu);
+__uint8_t CP_A_HL(CPU *cpu);
+__uint8_t CP_A_r8(CPU *cpu, __uint8_t r8);
+__uint8_t JP_CC_n16(CPU *cpu, __uint8_t cc);
+__uint8_t JP_n16(CPU *cpu);
+__uint8_t JP_HL(CPU *cpu);
+__uint8_t JR_CC_n16(CPU *cpu, __uint8_t cc);
+__uint8_t JR_n16(CPU *cpu);
+__uint8_t CALL_CC_n16(CPU *cpu, __uint8_t cc);
+__uint8_t CALL_n16(CPU *cpu);
+__uint8_t RST_vec(CPU *cpu, __uint8_t address);
+__uint8_t RET_CC(CPU *cpu, __uint8_t cc);
+__uint8_t RET(CPU *cpu);
+__uint8_t RETI(CPU *cpu);
+__uint8_t exec_CB(CPU *cpu);
+void update_IME(CPU *cpu, __uint8_t opcode);
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdlib.h>
+#include "pacing.h"
+
+// Frame pacing at the DMG refresh rate. Each frame has an absolute
+// deadline one period after the previous one. The emulation thread sleeps
+// with clock_nanosleep(TIMER_ABSTIME) until shortly before the deadline
+// and busy-waits the rest, the spin tail tracking how late the kernel
+// actually wakes us. Deadlines advance by the period, not from "now", so
+// an early or late frame doesn't shift the ones after it.
+//
+// With vsync, SDL_RenderPresent also blocks until the host refresh, which
+// is rarely exactly 59.7275 Hz. The emulated clock still decides: frames
+// are presented while emulation is on time, and presents are skipped while
+// it's more than a frame behind (a 60 Hz display drops a frame every few
+// seconds, a 59.94 Hz one repeats one), so the game never runs at the
+// host's rate.
+
+#define MIN_SPIN_NS 50000
+#define MAX_SPIN_NS 2000000
+
+static __int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Pacer *pacer_init(bool vsync)
+{
+    Pacer *pacer = calloc(1, sizeof(Pacer));
+    pacer->vsync = vsync;
+    pacer->last_frame = now_ns();
+    pacer->deadline = pacer->last_frame + PACING_FRAME_NS;
+    pacer->spin_ns = 500000;
+    pacer->min_ms = 1e9;
+    return pacer;
+}
+
+// Called at the frame boundary, before display_frame
+bool pacer_should_present(Pacer *pacer)
+{
+    if (now_ns() > pacer->deadline + PACING_FRAME_NS)
+    {
+        pacer->skipped_presents++;
+        return false;
+    }
+    return true;
+}
+
+static void sleep_until(Pacer *pacer, __int64_t deadline)
+{
+    __int64_t wake = deadline - pacer->spin_ns;
+    if (wake > now_ns())
+    {
+        struct timespec ts = {wake / 1000000000, wake % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+            ;
+        // Follow the kernel's wakeup latency: spin a bit longer than the
+        // worst recent overshoot, decaying slowly when it improves
+        __int64_t late = now_ns() - wake;
+        if (late > pacer->spin_ns / 2)
+            pacer->spin_ns = late * 2;
+        else
+            pacer->spin_ns -= pacer->spin_ns / 64;
+        if (pacer->spin_ns < MIN_SPIN_NS)
+            pacer->spin_ns = MIN_SPIN_NS;
+        if (pacer->spin_ns > MAX_SPIN_NS)
+            pacer->spin_ns = MAX_SPIN_NS;
+    }
+
+    __int64_t spin_start = now_ns();
+    __int64_t now = spin_start;
+    while (now < deadline)
+        now = now_ns();
+    pacer->spun_ns += now - spin_start;
+}
+
+// Called once the frame has been presented (or skipped)
+void pacer_end_frame(Pacer *pacer)
+{
+    __int64_t now = now_ns();
+
+    if (now > pacer->deadline + PACING_MAX_LAG_FRAMES * (__int64_t)PACING_FRAME_NS)
+    {
+        // Host can't keep up (or was suspended): start over from here
+        // instead of running flat out to make up for lost time
+        pacer->resyncs++;
+        pacer->deadline = now;
+    }
+    else if (now < pacer->deadline)
+        sleep_until(pacer, pacer->deadline);
+    pacer->deadline += PACING_FRAME_NS;
+
+    now = now_ns();
+    double ms = (now - pacer->last_frame) / 1e6;
+    pacer->last_frame = now;
+    pacer->frames++;
+    pacer->sum_ms += ms;
+    pacer->sum_sq_ms += ms * ms;
+    if (ms < pacer->min_ms)
+        pacer->min_ms = ms;
+    if (ms > pacer->max_ms)
+        pacer->max_ms = ms;
+    int bucket = ms * 1000 / PACING_HISTOGRAM_US;
+    pacer->histogram[bucket < PACING_HISTOGRAM_SIZE ? bucket : PACING_HISTOGRAM_SIZE - 1]++;
+}
+
+static double percentile(Pacer *pacer, double p)
+{
+    __uint64_t target = pacer->frames * p;
+    __uint64_t seen = 0;
+    for (int i = 0; i < PACING_HISTOGRAM_SIZE; i++)
+    {
+        seen += pacer->histogram[i];
+        if (seen > target)
+            return (i + 1) * PACING_HISTOGRAM_US / 1000.0;
+    }
+    return PACING_HISTOGRAM_SIZE * PACING_HISTOGRAM_US / 1000.0;
+}
+
+void pacer_report(Pacer *pacer, FILE *out)
+{
+    if (pacer->frames == 0)
+        return;
+
+    double mean = pacer->sum_ms / pacer->frames;
+    double variance = pacer->sum_sq_ms / pacer->frames - mean * mean;
+    fprintf(out, "Pacing: %lu frames at %.4f Hz (target %.4f Hz)%s\n", pacer->frames, 1000.0 / mean,
+            1e9 / PACING_FRAME_NS, pacer->vsync ? ", vsync" : "");
+    fprintf(out, "Pacing: frame time mean %.3f ms, stddev %.3f ms, min %.3f ms, max %.3f ms, p50 <%.1f ms, p99 <%.1f ms\n",
+            mean, variance > 0 ? sqrt(variance) : 0, pacer->min_ms, pacer->max_ms,
+            percentile(pacer, 0.50), percentile(pacer, 0.99));
+    fprintf(out, "Pacing: %lu presents skipped, %lu resyncs, %.1f ms spent spinning\n",
+            pacer->skipped_presents, pacer->resyncs, pacer->spun_ns / 1e6);
+}
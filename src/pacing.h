@@ -0,0 +1,30 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#define PACING_FRAME_NS 16742706 // 70224 T-cycles at 4194304 Hz (59.7275 Hz)
+#define PACING_MAX_LAG_FRAMES 4  // further behind than this, stop trying to catch up
+#define PACING_HISTOGRAM_US 100  // frame time histogram bucket
+#define PACING_HISTOGRAM_SIZE 500
+
+typedef struct Pacer
+{
+    bool vsync; // SDL_RenderPresent waits for the display refresh
+    __int64_t deadline;    // ns, CLOCK_MONOTONIC, end of the current frame
+    __int64_t last_frame;  // ns, when the previous frame was released
+    __int64_t spin_ns;     // busy-wait tail after clock_nanosleep
+    __uint64_t frames;
+    __uint64_t skipped_presents;
+    __uint64_t resyncs;
+    __uint64_t spun_ns;
+    double sum_ms;
+    double sum_sq_ms;
+    double min_ms;
+    double max_ms;
+    __uint32_t histogram[PACING_HISTOGRAM_SIZE];
+} Pacer;
+
+Pacer *pacer_init(bool vsync);
+bool pacer_should_present(Pacer *pacer);
+void pacer_end_frame(Pacer *pacer);
+void pacer_report(Pacer *pacer, FILE *out);
@@ -1,5 +1,10 @@
 #include "ppu.h"
 #include "cpu.h"
+#include "pacing.h"
+#include "display.h"
+#include "recorder.h"
+#include "joypad.h"
+#include "serial.h"
 
 SDL_Window *SDL_Window_init()
 {
@@ -24,9 +29,10 @@ SDL_Window *SDL_Window_init()
     return window;
 }
 
-SDL_Renderer *SDL_Renderer_init(SDL_Window *window)
+SDL_Renderer *SDL_Renderer_init(SDL_Window *window, bool vsync)
 {
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    Uint32 flags = SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, flags);
     if (renderer == NULL)
     {
         printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
@@ -36,7 +42,7 @@ SDL_Renderer *SDL_Renderer_init(SDL_Window *window)
     return renderer;
 }
 
-__uint8_t display_frame(SDL_Window *window, SDL_Renderer *renderer, __uint8_t *frame)
+void display_frame(SDL_Window *window, SDL_Renderer *renderer, __uint8_t *frame)
 {
     __uint8_t cell_width = WINDOW_WIDTH / 160;
     __uint8_t cell_height = WINDOW_HEIGHT / 144;
@@ -462,6 +468,17 @@ void render_scanline(CPU *cpu, Fetcher *fetcher, __uint8_t ly)
     fetcher->curr_p += 8;
 }
 
+// What render_scanline does to the fetcher, without fetching or drawing.
+// The sprite and pixel queues it would fill are emptied before the next
+// line, so this is all that outlives the call.
+void skip_scanline(CPU *cpu, Fetcher *fetcher)
+{
+    if (!(cpu->memory[LCDC] & 1u))
+        return;
+    fetcher->x_offset = (fetcher->x_offset + 1) % 32;
+    fetcher->curr_p += 8;
+}
+
 void reset_ppu(CPU *cpu)
 {
     Fetcher *fetcher = cpu->fetcher;
@@ -497,6 +514,21 @@ __uint8_t get_ppu_mode(CPU *cpu)
     }
 }
 
+// The host's side of a frame: input, recording, presenting and pacing
+static void end_frame(CPU *cpu)
+{
+    cpu->frames++;
+    joypad_frame(cpu);
+    if (cpu->recorder)
+        recorder_push(cpu->recorder, cpu->ppu.frame);
+    if (cpu->display && (cpu->pacer == NULL || pacer_should_present(cpu->pacer)))
+        display_publish(cpu->display, cpu->ppu.frame);
+    if (cpu->pacer)
+        pacer_end_frame(cpu->pacer);
+    if (cpu->serial)
+        serial_frame(cpu->serial);
+}
+
 void update_ppu(CPU *cpu, __uint8_t t_cycles)
 {
     __uint8_t lcd_enabled = cpu->memory[LCDC] & 0x80;
@@ -507,8 +539,17 @@ void update_ppu(CPU *cpu, __uint8_t t_cycles)
     {
         reset_ppu(cpu);
         cpu->memory[STAT] = (cpu->memory[STAT] & 0xFC) | 0;
+        // Frames go on every 70224 cycles with the LCD off, showing the
+        // last picture, so input, pacing and frame limits don't stall
+        cpu->ppu.off_cycles += t_cycles;
+        if (cpu->ppu.off_cycles >= 70224)
+        {
+            cpu->ppu.off_cycles -= 70224;
+            end_frame(cpu);
+        }
         return;
     }
+    cpu->ppu.off_cycles = 0;
 
     __uint8_t lcdc = cpu->memory[LCDC];
     __uint8_t wx = cpu->memory[WX];
@@ -585,7 +626,10 @@ void update_ppu(CPU *cpu, __uint8_t t_cycles)
         if (mode == 3 && fetcher->curr_p < 160 && *ly < 144)
         {
             cpu->pixel_transfer = true;
-            render_scanline(cpu, fetcher, *ly);
+            if (cpu->skip_pixels)
+                skip_scanline(cpu, fetcher);
+            else
+                render_scanline(cpu, fetcher, *ly);
         }
     }
     else
@@ -620,7 +664,7 @@ void update_ppu(CPU *cpu, __uint8_t t_cycles)
         cpu->fetcher->window_line_counter = 0;
         *ly = 0;
         cpu->fetcher->x_offset = 0;
-        display_frame(cpu->window, cpu->renderer, cpu->ppu.frame);
+        end_frame(cpu);
         PixelQueue_clear(&cpu->ppu.bg_queue);
         SpriteBuffer_clear(&cpu->ppu.sprite_buffer);
     }
@@ -55,6 +55,7 @@ typedef struct PPU
 {
     __uint32_t cycles;
     __uint32_t line_cycles;
+    __uint32_t off_cycles; // since the last frame ended with the LCD off
     __uint8_t frame[144 * 160];
     __uint8_t prev_ly;
     PixelQueue bg_queue;
@@ -71,6 +72,10 @@ typedef struct Fetcher
 } Fetcher;
 
 SDL_Window *SDL_Window_init();
-SDL_Renderer *SDL_Renderer_init(SDL_Window *window);
+SDL_Renderer *SDL_Renderer_init(SDL_Window *window, bool vsync);
+void display_frame(SDL_Window *window, SDL_Renderer *renderer, __uint8_t *frame);
 void update_dma(CPU *cpu);
+void oam_scan(CPU *cpu);
+void render_scanline(CPU *cpu, Fetcher *fetcher, __uint8_t ly); // fetches and draws the next 8 pixels
+void skip_scanline(CPU *cpu, Fetcher *fetcher);                  // advances the fetcher the same, draws nothing
 void update_ppu(CPU *cpu, __uint8_t t_cycles);
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "profile.h"
+
+// Execution counts and T-cycles per base opcode, CB opcode and pair of
+// consecutive base opcodes. Each thread counts into its own table, so the
+// hot path is a few increments with no atomics; the tables are chained on
+// a global list and summed when the report is written at exit.
+
+typedef struct ProfileCounters
+{
+    __uint64_t count[256];
+    __uint64_t cycles[256];
+    __uint64_t cb_count[256];
+    __uint64_t cb_cycles[256];
+    __uint64_t pair_count[256][256];
+    __uint64_t pair_cycles[256][256];
+    __uint8_t prev_opcode;
+    __uint8_t prev_cycles;
+    struct ProfileCounters *next;
+} ProfileCounters;
+
+static ProfileCounters *threads;
+static __thread ProfileCounters *local;
+
+static void write_report(void)
+{
+    FILE *out = fopen(PROFILE_OUTPUT, "w");
+    if (out == NULL)
+    {
+        perror("Error opening profile output");
+        return;
+    }
+    profile_report(out);
+    fclose(out);
+    fprintf(stderr, "Opcode profile written to %s\n", PROFILE_OUTPUT);
+}
+
+static ProfileCounters *counters(void)
+{
+    if (local)
+        return local;
+
+    local = calloc(1, sizeof(ProfileCounters));
+    if (local == NULL)
+    {
+        printf("Failed to allocate profile counters\n");
+        exit(1);
+    }
+    local->next = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&threads, &local->next, local, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        ;
+    if (local->next == NULL)
+        atexit(write_report);
+    return local;
+}
+
+void profile_opcode(__uint8_t opcode, __uint8_t t_cycles)
+{
+    ProfileCounters *p = counters();
+
+    p->count[opcode]++;
+    p->cycles[opcode] += t_cycles;
+    p->pair_count[p->prev_opcode][opcode]++;
+    p->pair_cycles[p->prev_opcode][opcode] += p->prev_cycles + t_cycles;
+    p->prev_opcode = opcode;
+    p->prev_cycles = t_cycles;
+}
+
+void profile_cb(__uint8_t opcode, __uint8_t t_cycles)
+{
+    ProfileCounters *p = counters();
+
+    p->cb_count[opcode]++;
+    p->cb_cycles[opcode] += t_cycles;
+}
+
+typedef struct ProfileEntry
+{
+    __uint16_t key;
+    __uint64_t count;
+    __uint64_t cycles;
+} ProfileEntry;
+
+static int compare_cycles(const void *a, const void *b)
+{
+    const ProfileEntry *x = a;
+    const ProfileEntry *y = b;
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+static void print_table(FILE *out, const char *title, ProfileEntry *entries, int size, int limit)
+{
+    __uint64_t total = 0;
+
+    for (int i = 0; i < size; i++)
+        total += entries[i].cycles;
+    qsort(entries, size, sizeof(ProfileEntry), compare_cycles);
+
+    fprintf(out, "# %s: %lu T-cycles\n", title, total);
+    for (int i = 0; i < size && i < limit && entries[i].count; i++)
+    {
+        if (size > 256)
+            fprintf(out, "%02X %02X", entries[i].key >> 8, entries[i].key & 0xFF);
+        else
+            fprintf(out, "%02X   ", entries[i].key);
+        fprintf(out, " %12lu %14lu %6.2f%%\n", entries[i].count, entries[i].cycles,
+                total ? 100.0 * entries[i].cycles / total : 0.0);
+    }
+    fprintf(out, "\n");
+}
+
+void profile_report(FILE *out)
+{
+    ProfileEntry *entries = calloc(0x10000, sizeof(ProfileEntry));
+    ProfileCounters *threads_head = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < 256; i++)
+        entries[i].key = i;
+    for (ProfileCounters *p = threads_head; p; p = p->next)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            entries[i].count += p->count[i];
+            entries[i].cycles += p->cycles[i];
+        }
+    }
+    print_table(out, "opcodes by T-cycles (opcode count cycles share)", entries, 256, 256);
+
+    for (int i = 0; i < 256; i++)
+        entries[i] = (ProfileEntry){i, 0, 0};
+    for (ProfileCounters *p = threads_head; p; p = p->next)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            entries[i].count += p->cb_count[i];
+            entries[i].cycles += p->cb_cycles[i];
+        }
+    }
+    print_table(out, "CB opcodes by T-cycles (opcode count cycles share)", entries, 256, 256);
+
+    for (int i = 0; i < 0x10000; i++)
+        entries[i] = (ProfileEntry){i, 0, 0};
+    for (ProfileCounters *p = threads_head; p; p = p->next)
+    {
+        for (int i = 0; i < 0x10000; i++)
+        {
+            entries[i].count += p->pair_count[i >> 8][i & 0xFF];
+            entries[i].cycles += p->pair_cycles[i >> 8][i & 0xFF];
+        }
+    }
+    print_table(out, "opcode pairs by T-cycles (first second count cycles share)",
+                entries, 0x10000, PROFILE_TOP_PAIRS);
+
+    free(entries);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdio.h>
+
+// Opcode profiler, built with `make PROFILE=1`. Without PROFILE the hooks
+// compile to nothing.
+#ifdef PROFILE
+#define PROFILE_OPCODE(opcode, t_cycles) profile_opcode(opcode, t_cycles)
+#define PROFILE_CB(opcode, t_cycles) profile_cb(opcode, t_cycles)
+#else
+#define PROFILE_OPCODE(opcode, t_cycles) ((void)0)
+#define PROFILE_CB(opcode, t_cycles) ((void)0)
+#endif
+
+#define PROFILE_OUTPUT "profile.txt"
+#define PROFILE_TOP_PAIRS 100
+
+void profile_opcode(__uint8_t opcode, __uint8_t t_cycles);
+void profile_cb(__uint8_t opcode, __uint8_t t_cycles);
+void profile_report(FILE *out);
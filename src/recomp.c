@@ -0,0 +1,22 @@
+#include "recomp.h"
+
+static RecompStats stats;
+
+void recomp_step(CPU *cpu)
+{
+    __uint32_t t_cycles = recomp_run(cpu);
+
+    if (t_cycles)
+        stats.translated_cycles += t_cycles;
+    else
+        stats.interpreted_cycles += CPU_step(cpu);
+}
+
+void recomp_report(FILE *out)
+{
+    __uint64_t total = stats.translated_cycles + stats.interpreted_cycles;
+
+    fprintf(out, "Recompiled: %lu of %lu instruction T-cycles in translated code (%.1f%%), %lu interpreted\n",
+            stats.translated_cycles, total, total ? 100.0 * stats.translated_cycles / total : 0.0,
+            stats.interpreted_cycles);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdio.h>
+#include "cpu.h"
+
+typedef struct RecompStats
+{
+    __uint64_t translated_cycles;
+    __uint64_t interpreted_cycles;
+} RecompStats;
+
+// Provided by a translation unit generated with tools/recomp.c. Runs the
+// translated block starting at cpu->PC and returns the T-cycles it took, or 0
+// when PC isn't covered by the translation. Plain builds don't define it.
+__uint32_t recomp_run(CPU *cpu) __attribute__((weak));
+
+// Whether CPU_start has work before the next instruction: a frame or cycle
+// limit reached, or an OAM DMA to tick. Translated code returns to it then.
+static inline bool recomp_yield(CPU *cpu)
+{
+    return cpu->dma_cycles || (cpu->frame_limit && cpu->frames >= cpu->frame_limit) ||
+           (cpu->cycle_limit && cpu->cycles >= cpu->cycle_limit);
+}
+
+void recomp_step(CPU *cpu);
+void recomp_report(FILE *out);
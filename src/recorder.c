@@ -0,0 +1,296 @@
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "recorder.h"
+
+// The encoder never holds the emulation thread up unless it falls a full
+// queue behind (then the recording stays complete and the wait is
+// counted). Encoding a frame takes a fraction of a millisecond.
+//
+// GIF: DMG frames only use 4 shades, so images are 2-bit LZW streams with
+// a 4-entry global palette, and the LZW table is a trie with 4 children
+// per code. Every RECORDER_GIF_FRAME_SKIP-th frame is sampled. Only the
+// rectangle that changed since the last image is stored, and identical
+// frames just lengthen the previous image's delay.
+//
+// Y4M: every frame as 8-bit grey (Cmono), at exactly 4194304/70224 fps.
+
+#define FRAME_SIZE (144 * 160)
+#define GIF_CLEAR 4
+#define GIF_END 5
+#define GIF_MAX_DELAY 60000 // centiseconds, the field is 16 bits
+
+static const __uint8_t shades[4] = {255, 166, 77, 0}; // same as display_frame
+
+typedef struct BitWriter
+{
+    FILE *file;
+    __uint8_t block[255];
+    int length;
+    __uint32_t bits;
+    int count;
+} BitWriter;
+
+static void put_le16(FILE *file, __uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static void put_code(BitWriter *writer, __uint32_t code, int size)
+{
+    writer->bits |= code << writer->count;
+    writer->count += size;
+    while (writer->count >= 8)
+    {
+        writer->block[writer->length++] = writer->bits & 0xFF;
+        writer->bits >>= 8;
+        writer->count -= 8;
+        if (writer->length == 255)
+        {
+            fputc(255, writer->file);
+            fwrite(writer->block, 1, 255, writer->file);
+            writer->length = 0;
+        }
+    }
+}
+
+static void finish_codes(BitWriter *writer)
+{
+    if (writer->count > 0)
+        put_code(writer, 0, 8 - writer->count);
+    if (writer->length > 0)
+    {
+        fputc(writer->length, writer->file);
+        fwrite(writer->block, 1, writer->length, writer->file);
+    }
+    fputc(0, writer->file); // block terminator
+}
+
+// When frame number frame starts, in centiseconds rounded
+static __uint64_t frame_centiseconds(__uint64_t frame)
+{
+    return (frame * 70224 * 100 + 4194304 / 2) / 4194304;
+}
+
+static void write_gif_header(Recorder *recorder)
+{
+    FILE *file = recorder->file;
+
+    fwrite("GIF89a", 1, 6, file);
+    put_le16(file, 160);
+    put_le16(file, 144);
+    fputc(0x91, file); // global color table of 4 entries, 2 bits per color
+    fputc(0, file);    // background color
+    fputc(0, file);    // square pixels
+    for (int i = 0; i < 4; i++)
+    {
+        for (int c = 0; c < 3; c++)
+            fputc(shades[i], file);
+    }
+    // Loop forever
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, file);
+}
+
+// Writes the pending image, or the part of it that differs from what the
+// file shows, to stay on screen until end (centiseconds)
+static void write_gif_image(Recorder *recorder, __uint64_t end)
+{
+    FILE *file = recorder->file;
+    int left = 160, top = 144, right = -1, bottom = -1;
+
+    for (int y = 0; y < 144; y++)
+    {
+        for (int x = 0; x < 160; x++)
+        {
+            if (recorder->pending[y * 160 + x] != recorder->previous[y * 160 + x] || recorder->written == 0)
+            {
+                left = x < left ? x : left;
+                right = x > right ? x : right;
+                top = y < top ? y : top;
+                bottom = y > bottom ? y : bottom;
+            }
+        }
+    }
+    if (right < 0)
+        left = right = top = bottom = 0; // nothing changed, still needs an image to carry the delay
+
+    __uint64_t delay = end - recorder->pending_start;
+    // Graphic control extension: keep the previous image under this one
+    fwrite("\x21\xF9\x04\x04", 1, 4, file);
+    put_le16(file, delay ? delay : 1);
+    fputc(0, file);
+    fputc(0, file);
+    // Image descriptor, no local color table
+    fputc(0x2C, file);
+    put_le16(file, left);
+    put_le16(file, top);
+    put_le16(file, right - left + 1);
+    put_le16(file, bottom - top + 1);
+    fputc(0, file);
+
+    BitWriter writer = {.file = file};
+    __uint32_t size = 3;
+    __uint32_t max_code = GIF_END;
+    __int32_t current = -1;
+
+    fputc(2, file); // LZW minimum code size
+    memset(recorder->lzw, 0, sizeof(recorder->lzw));
+    put_code(&writer, GIF_CLEAR, size);
+    for (int y = top; y <= bottom; y++)
+    {
+        for (int x = left; x <= right; x++)
+        {
+            __uint8_t pixel = recorder->pending[y * 160 + x];
+            recorder->previous[y * 160 + x] = pixel;
+            if (current < 0)
+            {
+                current = pixel;
+                continue;
+            }
+            if (recorder->lzw[current][pixel])
+            {
+                current = recorder->lzw[current][pixel];
+                continue;
+            }
+            put_code(&writer, current, size);
+            recorder->lzw[current][pixel] = ++max_code;
+            if (max_code >= (1u << size))
+                size++;
+            if (max_code == 4095)
+            {
+                put_code(&writer, GIF_CLEAR, size);
+                memset(recorder->lzw, 0, sizeof(recorder->lzw));
+                size = 3;
+                max_code = GIF_END;
+            }
+            current = pixel;
+        }
+    }
+    put_code(&writer, current, size);
+    put_code(&writer, GIF_END, size);
+    finish_codes(&writer);
+    recorder->written++;
+}
+
+static void encode_gif(Recorder *recorder, const __uint8_t *frame, __uint64_t index)
+{
+    if (index % RECORDER_GIF_FRAME_SKIP)
+        return;
+    __uint64_t start = frame_centiseconds(index);
+    if (recorder->has_pending)
+    {
+        if (memcmp(frame, recorder->pending, FRAME_SIZE) == 0 && start - recorder->pending_start < GIF_MAX_DELAY)
+            return;
+        write_gif_image(recorder, start);
+    }
+    memcpy(recorder->pending, frame, FRAME_SIZE);
+    recorder->pending_start = start;
+    recorder->has_pending = true;
+}
+
+static void encode_y4m(Recorder *recorder, const __uint8_t *frame)
+{
+    __uint8_t luma[FRAME_SIZE];
+
+    for (int i = 0; i < FRAME_SIZE; i++)
+        luma[i] = shades[frame[i] & 3];
+    fwrite("FRAME\n", 1, 6, recorder->file);
+    if (fwrite(luma, 1, FRAME_SIZE, recorder->file) != FRAME_SIZE)
+    {
+        perror("Error writing recording");
+        exit(1);
+    }
+    recorder->written++;
+}
+
+static void *encoder_main(void *arg)
+{
+    Recorder *recorder = arg;
+    struct timespec idle = {0, 1000000};
+
+    for (;;)
+    {
+        __uint64_t tail = recorder->tail;
+        if (__atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE) == tail)
+        {
+            if (__atomic_load_n(&recorder->closing, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE) == tail)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        const __uint8_t *frame = recorder->queue[tail & (RECORDER_QUEUE_FRAMES - 1)];
+        if (recorder->gif)
+            encode_gif(recorder, frame, tail);
+        else
+            encode_y4m(recorder, frame);
+        __atomic_store_n(&recorder->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+Recorder *recorder_open(const char *path)
+{
+    Recorder *recorder = calloc(1, sizeof(Recorder));
+    size_t length = strlen(path);
+
+    recorder->gif = length >= 4 && strcasecmp(path + length - 4, ".gif") == 0;
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL)
+    {
+        perror("Error opening recording");
+        exit(1);
+    }
+    if (recorder->gif)
+        write_gif_header(recorder);
+    else
+        fprintf(recorder->file, "YUV4MPEG2 W160 H144 F4194304:70224 Ip A1:1 Cmono\n");
+    recorder->queue = malloc(RECORDER_QUEUE_FRAMES * sizeof(*recorder->queue));
+    if (recorder->queue == NULL)
+    {
+        printf("Failed to allocate recording queue\n");
+        exit(1);
+    }
+    if (pthread_create(&recorder->encoder, NULL, encoder_main, recorder) != 0)
+    {
+        printf("Failed to start recording encoder\n");
+        exit(1);
+    }
+    return recorder;
+}
+
+void recorder_close(Recorder *recorder)
+{
+    if (recorder == NULL)
+        return;
+    __atomic_store_n(&recorder->closing, true, __ATOMIC_RELEASE);
+    pthread_join(recorder->encoder, NULL);
+    if (recorder->gif)
+    {
+        if (recorder->has_pending)
+            write_gif_image(recorder, frame_centiseconds(recorder->frames));
+        fputc(0x3B, recorder->file); // trailer
+    }
+    fclose(recorder->file);
+    free(recorder->queue);
+    recorder->queue = NULL;
+}
+
+void recorder_push(Recorder *recorder, const __uint8_t *frame)
+{
+    __uint64_t head = recorder->head;
+
+    if (head - __atomic_load_n(&recorder->tail, __ATOMIC_ACQUIRE) == RECORDER_QUEUE_FRAMES)
+    {
+        recorder->stalls++;
+        while (head - __atomic_load_n(&recorder->tail, __ATOMIC_ACQUIRE) == RECORDER_QUEUE_FRAMES)
+            sched_yield();
+    }
+    memcpy(recorder->queue[head & (RECORDER_QUEUE_FRAMES - 1)], frame, FRAME_SIZE);
+    recorder->frames++;
+    __atomic_store_n(&recorder->head, head + 1, __ATOMIC_RELEASE);
+}
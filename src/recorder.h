@@ -0,0 +1,34 @@
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#define RECORDER_QUEUE_FRAMES 64 // power of two, about a second of video
+#define RECORDER_GIF_FRAME_SKIP 2 // GIF delays are in 1/100 s, so every other frame
+
+// Records finished frames as an animated GIF or as Y4M (raw grey frames
+// for piping into an external encoder). The PPU pushes every frame into a
+// lock-free single-producer queue; an encoder thread drains it.
+typedef struct Recorder
+{
+    __uint8_t (*queue)[144 * 160];
+    __uint64_t head; // written by the emulation thread
+    __uint64_t tail; // written by the encoder thread
+    bool closing;
+    FILE *file;
+    bool gif;
+    pthread_t encoder;
+    __uint64_t frames;  // pushed by the PPU
+    __uint64_t written; // GIF images or Y4M frames in the file
+    __uint64_t stalls;  // times the emulation thread waited for the encoder
+    // GIF state, encoder thread only
+    __uint8_t previous[144 * 160]; // what the file shows so far
+    __uint8_t pending[144 * 160];  // held back until its delay is known
+    bool has_pending;
+    __uint64_t pending_start; // emulated time the pending image appears, centiseconds
+    __uint16_t lzw[4096][4];  // code table as a trie, 4 colors per node, 0 is no entry
+} Recorder;
+
+// A path ending in .gif records a GIF, anything else Y4M
+Recorder *recorder_open(const char *path);
+void recorder_close(Recorder *recorder);
+void recorder_push(Recorder *recorder, const __uint8_t *frame);
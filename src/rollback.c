@@ -0,0 +1,221 @@
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "rollback.h"
+#include "state.h"
+#define NONE UINT64_MAX
+
+static __int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Rollback *rollback_connect(CPU *cpu, const char *path, int window)
+{
+    Rollback *rollback = calloc(1, sizeof(Rollback));
+    struct sockaddr_un address = {0};
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("Socket path too long: %s\n", path);
+        exit(1);
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    rollback->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (rollback->socket < 0 || connect(rollback->socket, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    rollback->cpu = cpu;
+    rollback->window = window;
+    rollback->state_size = state_size(cpu);
+    rollback->states = malloc(rollback->state_size * (window + 1));
+    rollback->capacity = 4096;
+    rollback->local = malloc(rollback->capacity);
+    rollback->remote = malloc(rollback->capacity);
+    rollback->used = malloc(rollback->capacity);
+    rollback->mispredicted = NONE;
+    return rollback;
+}
+
+static void grow(Rollback *rollback, __uint64_t frame)
+{
+    if (frame < rollback->capacity)
+        return;
+    while (frame >= rollback->capacity)
+        rollback->capacity *= 2;
+    rollback->local = realloc(rollback->local, rollback->capacity);
+    rollback->remote = realloc(rollback->remote, rollback->capacity);
+    rollback->used = realloc(rollback->used, rollback->capacity);
+}
+
+static __uint8_t *slot(Rollback *rollback, __uint64_t frame)
+{
+    return rollback->states + (frame % (rollback->window + 1)) * rollback->state_size;
+}
+
+static void send_message(Rollback *rollback, __uint8_t type, __uint64_t frame, __uint8_t buttons)
+{
+    RollbackMessage message = {frame, type, buttons, 0};
+    if (send(rollback->socket, &message, sizeof(message), MSG_NOSIGNAL) != sizeof(message))
+    {
+        perror("Rollback peer");
+        exit(1);
+    }
+}
+
+// Takes the remote input that has arrived, with wait at least one frame's
+static void receive(Rollback *rollback, bool wait)
+{
+    struct pollfd fd = {rollback->socket, POLLIN, 0};
+    RollbackMessage message;
+
+    while (poll(&fd, 1, wait ? -1 : 0) > 0)
+    {
+        if (recv(rollback->socket, &message, sizeof(message), MSG_WAITALL) != sizeof(message) ||
+            message.type != ROLLBACK_INPUT || message.frame != rollback->received)
+        {
+            printf("Rollback peer disconnected or out of order\n");
+            exit(1);
+        }
+        grow(rollback, message.frame);
+        rollback->remote[message.frame] = message.buttons;
+        if (message.frame < rollback->frame && message.buttons != rollback->used[message.frame] &&
+            rollback->mispredicted == NONE)
+            rollback->mispredicted = message.frame;
+        rollback->received++;
+        wait = false;
+    }
+}
+
+// The remote input for frame, or the prediction: the last one received
+static __uint8_t remote_input(Rollback *rollback, __uint64_t frame)
+{
+    if (frame < rollback->received)
+        return rollback->remote[frame];
+    return rollback->received ? rollback->remote[rollback->received - 1] : 0;
+}
+
+// Saves the start of frame and runs it
+static void run_frame(Rollback *rollback, __uint64_t frame)
+{
+    CPU *cpu = rollback->cpu;
+
+    rollback->used[frame] = remote_input(rollback, frame);
+    cpu->buttons = rollback->local[frame] | rollback->used[frame];
+    __int64_t start = now_ns();
+    state_save(cpu, slot(rollback, frame));
+    rollback->save_ns += now_ns() - start;
+    cpu->frame_limit = cpu->frames + 1;
+    CPU_start(cpu, NULL);
+}
+
+// Goes back to the first mispredicted frame and runs up to the present
+// again with the input known now, on a silent host that unless draw is set
+// skips the pixels too.
+static void resimulate(Rollback *rollback, bool draw)
+{
+    CPU *cpu = rollback->cpu;
+    Host host = CPU_host(cpu);
+    Host silent = CPU_silent_host(&host);
+    __uint64_t from = rollback->mispredicted;
+    __int64_t start = now_ns();
+
+    if (!state_load(cpu, slot(rollback, from), rollback->state_size))
+    {
+        printf("Rollback save state didn't load\n");
+        exit(1);
+    }
+    silent.skip_pixels = !draw;
+    CPU_set_host(cpu, &silent);
+    for (__uint64_t frame = from; frame < rollback->frame; frame++)
+        run_frame(rollback, frame);
+    CPU_set_host(cpu, &host);
+
+    rollback->rollbacks++;
+    rollback->resimulated += rollback->frame - from;
+    if (rollback->frame - from > rollback->max_resimulated)
+        rollback->max_resimulated = rollback->frame - from;
+    rollback->resimulate_ns += now_ns() - start;
+    rollback->mispredicted = NONE;
+}
+
+// One host frame
+static void step(Rollback *rollback)
+{
+    __uint64_t frame = rollback->frame;
+
+    grow(rollback, frame);
+    // joypad_frame sampled the keyboard at the end of the last frame
+    rollback->local[frame] = rollback->cpu->buttons;
+    send_message(rollback, ROLLBACK_INPUT, frame, rollback->local[frame]);
+    receive(rollback, false);
+    // Frames before received + window can still be rolled back to
+    if (rollback->received + rollback->window <= frame)
+    {
+        rollback->stalls++;
+        send_message(rollback, ROLLBACK_FLUSH, frame - rollback->window, 0);
+        while (rollback->received + rollback->window <= frame)
+            receive(rollback, true);
+    }
+    if (rollback->mispredicted != NONE)
+        resimulate(rollback, false);
+    run_frame(rollback, frame);
+    rollback->frame++;
+}
+
+void rollback_run(Rollback *rollback, SDL_Event *e)
+{
+    CPU *cpu = rollback->cpu;
+    __uint64_t frame_limit = cpu->frame_limit;
+    bool quit = false;
+
+    while (!quit && !(frame_limit && cpu->frames >= frame_limit))
+    {
+        step(rollback);
+        while (e && SDL_PollEvent(e) != 0)
+        {
+            if (e->type == SDL_QUIT)
+                quit = true;
+        }
+    }
+    if (rollback->frame)
+    {
+        send_message(rollback, ROLLBACK_FLUSH, rollback->frame - 1, 0);
+        while (rollback->received < rollback->frame)
+            receive(rollback, true);
+        if (rollback->mispredicted != NONE)
+            resimulate(rollback, true);
+    }
+    cpu->frame_limit = frame_limit;
+}
+
+void rollback_report(Rollback *rollback, FILE *out)
+{
+    __uint64_t frames = rollback->frame ? rollback->frame : 1;
+    __uint64_t resimulated = rollback->resimulated ? rollback->resimulated : 1;
+
+    fprintf(out, "Rollback: %lu frames, %lu rollbacks re-simulating %lu frames (at most %lu in a host frame, %.1f us per "
+                 "frame), %lu frames waited for remote input, save states %.1f us\n",
+            rollback->frame, rollback->rollbacks, rollback->resimulated, rollback->max_resimulated,
+            rollback->resimulate_ns / 1e3 / resimulated, rollback->stalls,
+            rollback->save_ns / 1e3 / (frames + rollback->resimulated));
+    fprintf(out, "Rollback: final frame hash %016lx\n", state_frame_hash(rollback->cpu));
+}
+
+void rollback_close(Rollback *rollback)
+{
+    close(rollback->socket);
+    free(rollback->states);
+    free(rollback->local);
+    free(rollback->remote);
+    free(rollback->used);
+    free(rollback);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdio.h>
+#include "cpu.h"
+#include "rollback_format.h"
+#define ROLLBACK_DEFAULT_FRAMES 8
+#define ROLLBACK_MAX_FRAMES 60
+
+// Rollback netplay against a remote player on a Unix socket. The remote
+// player's buttons are ORed with the local ones. Every frame runs at once
+// with the remote input predicted to be what it last was. When the real
+// input arrives and differs, the machine goes back to the save state of the
+// first mispredicted frame and re-simulates up to the present without
+// drawing, within the same host frame. Remote input may lag up to window
+// frames; beyond that the emulator waits for it.
+typedef struct Rollback
+{
+    CPU *cpu;
+    int socket;
+    int window;         // frames that can be rolled back
+    __uint64_t frame;   // the next frame to run
+    size_t state_size;
+    __uint8_t *states;  // window + 1 save states, the start of frame f in slot f % (window + 1)
+    __uint8_t *local;   // per frame
+    __uint8_t *remote;  // per frame, received for frames below received
+    __uint8_t *used;    // the remote buttons each frame ran with
+    size_t capacity;
+    __uint64_t received;
+    __uint64_t mispredicted; // first frame that ran with the wrong input, UINT64_MAX for none
+    __uint64_t rollbacks;
+    __uint64_t resimulated;  // frames
+    __uint64_t max_resimulated; // in one host frame
+    __uint64_t stalls;       // frames that waited for remote input
+    __uint64_t resimulate_ns;
+    __uint64_t save_ns;
+} Rollback;
+
+Rollback *rollback_connect(CPU *cpu, const char *path, int window);
+// Runs until the window is closed or cpu->frame_limit, then waits for the
+// remote input of every frame run and ends on the confirmed state
+void rollback_run(Rollback *rollback, SDL_Event *e);
+void rollback_report(Rollback *rollback, FILE *out);
+void rollback_close(Rollback *rollback);
@@ -0,0 +1,19 @@
+#pragma once
+#include <sys/types.h>
+
+// Rollback input protocol, fixed-size messages in host byte order over a
+// Unix stream socket. Both ends send ROLLBACK_INPUT for every frame, in
+// order: the buttons (cpu->buttons bits) their player held during it. The
+// emulator asks for every input up to frame with ROLLBACK_FLUSH when it
+// can't go on without it: when the remote input lags more than it can roll
+// back, and before it exits, to end on a confirmed state.
+#define ROLLBACK_INPUT 'I'
+#define ROLLBACK_FLUSH 'F'
+
+typedef struct RollbackMessage
+{
+    __uint32_t frame;
+    __uint8_t type;
+    __uint8_t buttons;
+    __uint16_t unused;
+} RollbackMessage;
@@ -0,0 +1,112 @@
+#include <string.h>
+#include <time.h>
+#include "joypad.h"
+#include "runahead.h"
+#include "state.h"
+
+static __int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+RunAhead *runahead_init(CPU *cpu, int frames)
+{
+    RunAhead *runahead = calloc(1, sizeof(RunAhead));
+    runahead->cpu = cpu;
+    runahead->frames = frames;
+    runahead->state_size = state_size(cpu);
+    runahead->state = malloc(runahead->state_size);
+    return runahead;
+}
+
+static void run_one(CPU *cpu)
+{
+    cpu->frame_limit = cpu->frames + 1;
+    CPU_start(cpu, NULL);
+}
+
+void runahead_frame(RunAhead *runahead)
+{
+    CPU *cpu = runahead->cpu;
+    Host host = CPU_host(cpu);
+    __int64_t start = now_ns();
+
+    runahead->host_frames++;
+    if (runahead->frames == 0)
+    {
+        run_one(cpu);
+        memcpy(runahead->frame, cpu->ppu.frame, sizeof(runahead->frame));
+        runahead->real_ns += now_ns() - start;
+        return;
+    }
+
+    // The real frame is heard and recorded but not shown. Without the
+    // display its frame boundary takes the keys sampled here.
+    Host hidden = host;
+    hidden.display = NULL;
+    hidden.pacer = NULL;
+    if (host.display)
+        hidden.host_buttons = joypad_keyboard();
+    CPU_set_host(cpu, &hidden);
+    run_one(cpu);
+    __int64_t ahead_start = now_ns();
+    runahead->real_ns += ahead_start - start;
+
+    // The frames ahead hold the input the real frame ended with
+    __uint8_t buttons = cpu->buttons;
+    Host ahead = CPU_silent_host(&hidden);
+    state_save(cpu, runahead->state);
+    CPU_set_host(cpu, &ahead);
+    for (int i = 1; i < runahead->frames; i++)
+    {
+        cpu->buttons = buttons;
+        run_one(cpu);
+    }
+    ahead.display = host.display;
+    ahead.pacer = host.pacer;
+    ahead.skip_pixels = false;
+    CPU_set_host(cpu, &ahead);
+    cpu->buttons = buttons;
+    run_one(cpu);
+    memcpy(runahead->frame, cpu->ppu.frame, sizeof(runahead->frame));
+    state_load(cpu, runahead->state, runahead->state_size);
+    CPU_set_host(cpu, &host);
+    runahead->ahead_ns += now_ns() - ahead_start;
+}
+
+void runahead_run(RunAhead *runahead, SDL_Event *e)
+{
+    CPU *cpu = runahead->cpu;
+    __uint64_t frame_limit = cpu->frame_limit;
+    bool quit = false;
+
+    while (!quit && !(frame_limit && cpu->frames >= frame_limit))
+    {
+        runahead_frame(runahead);
+        while (e && SDL_PollEvent(e) != 0)
+        {
+            if (e->type == SDL_QUIT)
+                quit = true;
+        }
+    }
+    cpu->frame_limit = frame_limit;
+}
+
+void runahead_report(RunAhead *runahead, FILE *out)
+{
+    __uint64_t frames = runahead->host_frames ? runahead->host_frames : 1;
+
+    fprintf(out, "Run-ahead: %d frames over %lu host frames, real frame %.1f us, running ahead %.1f us", runahead->frames,
+            runahead->host_frames, runahead->real_ns / 1e3 / frames, runahead->ahead_ns / 1e3 / frames);
+    if (runahead->frames)
+        fprintf(out, " (%.1f us per frame ahead)", runahead->ahead_ns / 1e3 / frames / runahead->frames);
+    fprintf(out, "\n");
+}
+
+void runahead_free(RunAhead *runahead)
+{
+    free(runahead->state);
+    free(runahead);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdio.h>
+#include "cpu.h"
+#define RUNAHEAD_MAX_FRAMES 8
+
+// Run-ahead hides the frames of input lag a game has internally. Every host
+// frame samples the keys once, runs the real frame, which is heard and
+// recorded but not shown and takes those keys at its frame boundary, and
+// saves the state after it. The next frames run with the input that
+// boundary settled on, on a silent host (CPU_silent_host) except that the
+// last one is drawn and shown. Then the state is loaded back. With
+// frames = K a button shows up to K frames sooner, for K more frames of
+// emulation per host frame.
+typedef struct RunAhead
+{
+    CPU *cpu;
+    int frames;
+    size_t state_size;
+    __uint8_t *state;
+    __uint8_t frame[144 * 160]; // the last frame shown
+    __uint64_t host_frames;
+    __uint64_t real_ns;  // running the real frames
+    __uint64_t ahead_ns; // saving, running ahead and loading
+} RunAhead;
+
+RunAhead *runahead_init(CPU *cpu, int frames);
+// One host frame. Without a display the input is cpu->host_buttons.
+void runahead_frame(RunAhead *runahead);
+// Runs until the window is closed or cpu->frame_limit
+void runahead_run(RunAhead *runahead, SDL_Event *e);
+void runahead_report(RunAhead *runahead, FILE *out);
+void runahead_free(RunAhead *runahead);
@@ -0,0 +1,179 @@
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include "sampler.h"
+#include "memory.h"
+
+// Samples are taken between instructions (from CPU_start), so a sample
+// lands on the instruction about to run. With --jit a whole block runs
+// between samples and they pile up on block entry points.
+
+static volatile sig_atomic_t timer_expired;
+
+static void on_sigprof(int signal)
+{
+    (void)signal;
+    timer_expired = 1;
+}
+
+// ROM0, then one 16KB slice per switchable bank, then 0x8000-0xFFFF
+static size_t sample_index(Sampler *sampler, __uint8_t bank, __uint16_t address)
+{
+    if (address >= 0x8000)
+        return sampler->banks * 0x4000 + (address - 0x8000);
+    return bank * 0x4000 + (address & 0x3FFF);
+}
+
+static void index_address(Sampler *sampler, size_t index, __uint8_t *bank, __uint16_t *address)
+{
+    if (index >= sampler->banks * 0x4000)
+    {
+        *bank = 0;
+        *address = 0x8000 + (index - sampler->banks * 0x4000);
+    }
+    else
+    {
+        *bank = index / 0x4000;
+        *address = (*bank ? 0x4000 : 0) + (index & 0x3FFF);
+    }
+}
+
+Sampler *sampler_init(CPU *cpu, __uint64_t interval, long timer_usec, Symbols *symbols)
+{
+    Sampler *sampler = calloc(1, sizeof(Sampler));
+    sampler->interval = interval;
+    sampler->next_sample = cpu->cycles + interval;
+    sampler->banks = cpu->cartridge->rom_size / 0x4000;
+    if (sampler->banks < 2)
+        sampler->banks = 2;
+    sampler->counts = calloc(sampler->banks * 0x4000 + 0x8000, sizeof(__uint64_t));
+    sampler->symbols = symbols;
+
+    if (interval == 0)
+    {
+        struct sigaction action = {0};
+        action.sa_handler = on_sigprof;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGPROF, &action, NULL);
+
+        struct itimerval timer = {0};
+        timer.it_interval.tv_sec = timer_usec / 1000000;
+        timer.it_interval.tv_usec = timer_usec % 1000000;
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, NULL) != 0)
+        {
+            perror("Error starting profiling timer");
+            exit(1);
+        }
+    }
+    return sampler;
+}
+
+void sampler_free(Sampler *sampler)
+{
+    if (sampler == NULL)
+        return;
+    if (sampler->interval == 0)
+    {
+        struct itimerval timer = {0};
+        setitimer(ITIMER_PROF, &timer, NULL);
+        signal(SIGPROF, SIG_DFL);
+    }
+    free(sampler->counts);
+    free(sampler);
+}
+
+void sampler_tick(CPU *cpu)
+{
+    Sampler *sampler = cpu->sampler;
+
+    if (sampler->interval)
+    {
+        if (cpu->cycles < sampler->next_sample)
+            return;
+        sampler->next_sample += sampler->interval;
+    }
+    else
+    {
+        if (!timer_expired)
+            return;
+        timer_expired = 0;
+    }
+
+    __uint8_t bank = rom_bank_at(cpu->cartridge, cpu->PC);
+    sampler->counts[sample_index(sampler, bank, cpu->PC)]++;
+    sampler->samples++;
+}
+
+typedef struct SampleCount
+{
+    size_t key;
+    __uint64_t count;
+} SampleCount;
+
+static int compare_counts(const void *a, const void *b)
+{
+    const SampleCount *x = a;
+    const SampleCount *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+void sampler_report(Sampler *sampler, FILE *report, FILE *folded)
+{
+    size_t size = sampler->banks * 0x4000 + 0x8000;
+    Symbols *symbols = sampler->symbols;
+    size_t functions = symbols ? symbols->count : 0;
+    SampleCount *by_function = calloc(functions + 1, sizeof(SampleCount)); // last: no symbol
+    SampleCount *by_address = malloc(size * sizeof(SampleCount));
+    double total = sampler->samples ? sampler->samples : 1;
+
+    for (size_t i = 0; i <= functions; i++)
+        by_function[i].key = i;
+    for (size_t i = 0; i < size; i++)
+    {
+        __uint8_t bank;
+        __uint16_t address;
+        by_address[i].key = i;
+        by_address[i].count = sampler->counts[i];
+        if (sampler->counts[i] == 0)
+            continue;
+
+        index_address(sampler, i, &bank, &address);
+        const Symbol *symbol = symbols_lookup(symbols, bank, address);
+        by_function[symbol ? (size_t)(symbol - symbols->symbols) : functions].count += sampler->counts[i];
+        fprintf(folded, "%s%02X;%s;%02X:%04X %lu\n", address >= 0x8000 ? "RAM" : "ROM", bank,
+                symbol ? symbol->name : "unknown", bank, address, sampler->counts[i]);
+    }
+    qsort(by_function, functions + 1, sizeof(SampleCount), compare_counts);
+    qsort(by_address, size, sizeof(SampleCount), compare_counts);
+
+    fprintf(report, "# %lu samples (%s)\n\n", sampler->samples,
+            sampler->interval ? "emulated cycles" : "host SIGPROF timer");
+    if (symbols)
+    {
+        fprintf(report, "# functions (samples share name)\n");
+        for (size_t i = 0; i <= functions && by_function[i].count; i++)
+        {
+            size_t index = by_function[i].key;
+            fprintf(report, "%12lu %6.2f%% %s\n", by_function[i].count, 100.0 * by_function[i].count / total,
+                    index < functions ? symbols->symbols[index].name : "(no symbol)");
+        }
+        fprintf(report, "\n");
+    }
+    fprintf(report, "# addresses (samples share bank:address symbol)\n");
+    for (size_t i = 0; i < size && i < SAMPLER_TOP_ADDRESSES && by_address[i].count; i++)
+    {
+        __uint8_t bank;
+        __uint16_t address;
+        index_address(sampler, by_address[i].key, &bank, &address);
+        const Symbol *symbol = symbols_lookup(symbols, bank, address);
+        fprintf(report, "%12lu %6.2f%% %02X:%04X", by_address[i].count, 100.0 * by_address[i].count / total,
+                bank, address);
+        if (symbol)
+            fprintf(report, " %s+%u", symbol->name, address - symbol->address);
+        fprintf(report, "\n");
+    }
+
+    free(by_function);
+    free(by_address);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdio.h>
+#include "cpu.h"
+#include "symbols.h"
+#define SAMPLER_REPORT "hotspots.txt"
+#define SAMPLER_FOLDED "hotspots.folded"
+#define SAMPLER_TOP_ADDRESSES 50
+
+// Guest PC sampler: a (ROM bank, PC) histogram taken every interval
+// T-cycles, or on each host SIGPROF tick when interval is 0
+typedef struct Sampler
+{
+    __uint64_t interval;
+    __uint64_t next_sample;
+    __uint64_t *counts; // see sample_index
+    size_t banks;
+    __uint64_t samples;
+    Symbols *symbols; // NULL without a .sym file
+} Sampler;
+
+Sampler *sampler_init(CPU *cpu, __uint64_t interval, long timer_usec, Symbols *symbols);
+void sampler_free(Sampler *sampler);
+void sampler_tick(CPU *cpu);
+void sampler_report(Sampler *sampler, FILE *report, FILE *folded);
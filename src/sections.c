@@ -0,0 +1,78 @@
+#include <string.h>
+#include "sections.h"
+#define SECTION_CALIBRATION 1000 // hook pairs per batch
+#define SECTION_BATCHES 100
+
+const char *section_names[SECTION_COUNT] = {"other", "cpu", "timer", "apu", "ppu", "memory"};
+
+#ifdef SECTIONS
+__thread SectionTimes section_times;
+
+bool sections_enabled(void)
+{
+    return true;
+}
+
+void sections_reset(void)
+{
+    __uint64_t overhead = UINT64_MAX;
+
+    // Back to back, each charge is nothing but the cost of one hook. The
+    // fastest batch leaves out interrupts and migrations; hooks in the
+    // emulator run with colder caches and cost a bit more.
+    for (int batch = 0; batch < SECTION_BATCHES; batch++)
+    {
+        memset(&section_times, 0, sizeof(section_times));
+        section_times.last = section_clock();
+        for (int i = 0; i < SECTION_CALIBRATION; i++)
+        {
+            section_enter(SECTION_OTHER);
+            section_leave();
+        }
+        __uint64_t ticks = section_times.ticks[SECTION_OTHER] / (2 * SECTION_CALIBRATION);
+        if (ticks < overhead)
+            overhead = ticks;
+    }
+    memset(&section_times, 0, sizeof(section_times));
+    section_times.overhead = overhead;
+    section_times.last = section_clock();
+}
+
+void sections_read(__uint64_t ticks[SECTION_COUNT], __uint64_t *overhead)
+{
+    *overhead = 0;
+    for (int i = 0; i < SECTION_COUNT; i++)
+    {
+        __uint64_t hooks = section_times.charges[i] * section_times.overhead;
+        if (hooks > section_times.ticks[i])
+            hooks = section_times.ticks[i];
+        ticks[i] = section_times.ticks[i] - hooks;
+        *overhead += hooks;
+    }
+}
+
+__uint64_t sections_charge_overhead(void)
+{
+    return section_times.overhead;
+}
+#else
+bool sections_enabled(void)
+{
+    return false;
+}
+
+void sections_reset(void)
+{
+}
+
+void sections_read(__uint64_t ticks[SECTION_COUNT], __uint64_t *overhead)
+{
+    memset(ticks, 0, SECTION_COUNT * sizeof(__uint64_t));
+    *overhead = 0;
+}
+
+__uint64_t sections_charge_overhead(void)
+{
+    return 0;
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Where emulation time goes, for --bench: built with `make SECTIONS=1`,
+// every entry to and exit from a section reads the TSC and charges the
+// time since the last reading to the innermost open section, so the
+// shares are exclusive (update_timer's own work doesn't include the PPU).
+// Each charge also carries about one hook's own cost, which sections_reset
+// measures and sections_read takes off again per charge.
+// Without SECTIONS the hooks compile to nothing.
+typedef enum Section
+{
+    SECTION_OTHER, // main loop, interrupts, joypad, frame boundary work
+    SECTION_CPU,   // instruction decode and execute, any engine
+    SECTION_TIMER,
+    SECTION_APU,
+    SECTION_PPU,
+    SECTION_MEMORY, // read_memory/write_memory, except opcode fetches
+    SECTION_COUNT
+} Section;
+
+#define SECTION_MAX_DEPTH 16
+
+#ifdef SECTIONS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define section_clock() __rdtsc()
+#else
+#include <time.h>
+static inline __uint64_t section_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+typedef struct SectionTimes
+{
+    __uint64_t ticks[SECTION_COUNT];
+    __uint64_t charges[SECTION_COUNT];
+    __uint64_t overhead; // ticks per charge, measured by sections_reset
+    __uint64_t last;
+    int depth;
+    Section stack[SECTION_MAX_DEPTH];
+} SectionTimes;
+
+extern __thread SectionTimes section_times;
+
+static inline void section_charge(SectionTimes *t, __uint64_t now)
+{
+    Section section = t->stack[t->depth];
+    t->ticks[section] += now - t->last;
+    t->charges[section]++;
+    t->last = now;
+}
+
+static inline void section_enter(Section section)
+{
+    SectionTimes *t = &section_times;
+    section_charge(t, section_clock());
+    t->stack[++t->depth] = section;
+}
+
+// Leaves the innermost section for another at the same depth, one reading
+// instead of a leave and an enter
+static inline void section_switch(Section section)
+{
+    SectionTimes *t = &section_times;
+    section_charge(t, section_clock());
+    t->stack[t->depth] = section;
+}
+
+static inline void section_leave(void)
+{
+    SectionTimes *t = &section_times;
+    section_charge(t, section_clock());
+    t->depth--;
+}
+
+#define SECTION_ENTER(section) section_enter(section)
+#define SECTION_SWITCH(section) section_switch(section)
+#define SECTION_LEAVE() section_leave()
+#else
+#define SECTION_ENTER(section) ((void)0)
+#define SECTION_SWITCH(section) ((void)0)
+#define SECTION_LEAVE() ((void)0)
+#endif
+
+extern const char *section_names[SECTION_COUNT];
+
+// False in builds without SECTIONS
+bool sections_enabled(void);
+// Starts over, after measuring what a hook costs on this machine
+void sections_reset(void);
+// Ticks per section since the last reset, on this thread, without the
+// measured cost of the hooks. *overhead gets the ticks taken off in all.
+void sections_read(__uint64_t ticks[SECTION_COUNT], __uint64_t *overhead);
+// Ticks taken off per charge
+__uint64_t sections_charge_overhead(void);
@@ -0,0 +1,298 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "serial.h"
+
+// Socket protocol, two bytes per message: the clocking end sends
+// MESSAGE_TRANSFER with its byte when the transfer completes and blocks
+// until the MESSAGE_REPLY with the other end's byte comes back
+#define MESSAGE_TRANSFER 'T'
+#define MESSAGE_REPLY 'R'
+
+typedef struct Message
+{
+    __uint8_t type;
+    __uint8_t byte;
+} Message;
+
+static __int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Serial *serial_init(CPU *cpu)
+{
+    Serial *serial = calloc(1, sizeof(Serial));
+    serial->cpu = cpu;
+    serial->link = SERIAL_UNPLUGGED;
+    serial->socket = -1;
+    serial->capacity = 256;
+    serial->output = calloc(1, serial->capacity);
+    return serial;
+}
+
+void serial_free(Serial *serial)
+{
+    if (serial->socket >= 0)
+        close(serial->socket);
+    free(serial->output);
+    free(serial);
+}
+
+void serial_link_local(Serial *a, Serial *b)
+{
+    a->link = b->link = SERIAL_LOCAL;
+    a->peer = b;
+    b->peer = a;
+}
+
+static struct sockaddr_un socket_address(const char *path)
+{
+    struct sockaddr_un address = {0};
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("Socket path too long: %s\n", path);
+        exit(1);
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    return address;
+}
+
+void serial_listen(Serial *serial, const char *path)
+{
+    struct sockaddr_un address = socket_address(path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, 1) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    printf("Waiting for the other end of the link on %s\n", path);
+    serial->socket = accept(listener, NULL, NULL);
+    if (serial->socket < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    close(listener);
+    unlink(path);
+    serial->link = SERIAL_SOCKET;
+}
+
+void serial_connect(Serial *serial, const char *path)
+{
+    struct sockaddr_un address = socket_address(path);
+
+    serial->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (serial->socket < 0 || connect(serial->socket, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    serial->link = SERIAL_SOCKET;
+}
+
+// The other process went away, carry on with nothing plugged in
+static void unplug(Serial *serial)
+{
+    printf("Link closed\n");
+    close(serial->socket);
+    serial->socket = -1;
+    serial->link = SERIAL_UNPLUGGED;
+}
+
+static void log_byte(Serial *serial, __uint8_t byte)
+{
+    if (serial->length + 1 == serial->capacity)
+    {
+        serial->capacity *= 2;
+        serial->output = realloc(serial->output, serial->capacity);
+    }
+    serial->output[serial->length++] = byte;
+    serial->output[serial->length] = 0;
+    if (serial->echo)
+    {
+        putchar(byte);
+        fflush(stdout);
+    }
+}
+
+static void finish(CPU *cpu, __uint8_t in)
+{
+    cpu->memory[SB] = in;
+    cpu->memory[SC] &= 0x7F;
+    cpu->memory[IF] |= 0x08;
+}
+
+// The other end clocked a transfer and sent in; returns the byte this
+// machine shifted out, 0xFF unless it was waiting for the external clock
+static __uint8_t clocked_in(Serial *serial, __uint8_t in)
+{
+    CPU *cpu = serial->cpu;
+    __uint8_t out = cpu->memory[SB];
+
+    if ((cpu->memory[SC] & 0x81) != 0x80)
+        return 0xFF;
+    log_byte(serial, out);
+    serial->received++;
+    cpu->serial_cycles = 0;
+    finish(cpu, in);
+    return out;
+}
+
+// Answers a transfer the socket's other end clocked. With wait it
+// blocks until the reply to our own transfer arrives and returns its byte.
+static __uint8_t service(Serial *serial, bool wait)
+{
+    struct pollfd fd = {serial->socket, POLLIN, 0};
+    Message message;
+
+    while (serial->link == SERIAL_SOCKET)
+    {
+        int ready = poll(&fd, 1, wait ? -1 : 0);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            break;
+        if (recv(serial->socket, &message, sizeof(message), MSG_WAITALL) != sizeof(message))
+        {
+            unplug(serial);
+            break;
+        }
+        if (message.type == MESSAGE_REPLY)
+            return message.byte;
+        Message reply = {MESSAGE_REPLY, clocked_in(serial, message.byte)};
+        if (send(serial->socket, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+            unplug(serial);
+        // One transfer per poll, the game has to take the byte before the next
+        if (!wait)
+            break;
+    }
+    return 0xFF;
+}
+
+// Runs a local peer that is behind up to cycles, so it sees the transfer
+// at the same point in emulated time as the machine clocking it
+static void catch_up(CPU *peer, __uint64_t cycles)
+{
+    __uint64_t frame_limit = peer->frame_limit;
+    __uint64_t cycle_limit = peer->cycle_limit;
+
+    peer->frame_limit = 0;
+    peer->cycle_limit = cycles;
+    CPU_start(peer, NULL);
+    peer->frame_limit = frame_limit;
+    peer->cycle_limit = cycle_limit;
+}
+
+// The end of a transfer this machine clocked: sends out, returns the byte
+// shifted in
+static __uint8_t exchange(CPU *cpu, __uint8_t out)
+{
+    Serial *serial = cpu->serial;
+
+    if (serial == NULL)
+        return 0xFF;
+    log_byte(serial, out);
+    serial->clocked++;
+    switch (serial->link)
+    {
+    case SERIAL_LOCAL:
+        if (serial->peer->cpu->cycles < cpu->cycles)
+        {
+            catch_up(serial->peer->cpu, cpu->cycles);
+            serial->syncs++;
+        }
+        return clocked_in(serial->peer, out);
+    case SERIAL_SOCKET:
+    {
+        Message message = {MESSAGE_TRANSFER, out};
+        __int64_t start = now_ns();
+        __uint8_t in = 0xFF;
+        if (send(serial->socket, &message, sizeof(message), MSG_NOSIGNAL) != sizeof(message))
+            unplug(serial);
+        else
+            in = service(serial, true);
+        serial->wait_ns += now_ns() - start;
+        return in;
+    }
+    default:
+        return 0xFF;
+    }
+}
+
+static bool polling(CPU *cpu)
+{
+    return cpu->serial && cpu->serial->link == SERIAL_SOCKET && (cpu->memory[SC] & 0x81) == 0x80;
+}
+
+void serial_write(CPU *cpu, __uint16_t address, __uint8_t value)
+{
+    if (address == SB)
+    {
+        cpu->memory[SB] = value;
+        return;
+    }
+    cpu->memory[SC] = value | 0x7E;
+    if ((value & 0x81) == 0x81)
+        cpu->serial_cycles = SERIAL_TRANSFER_CYCLES;
+    else if (polling(cpu))
+        cpu->serial_cycles = SERIAL_POLL_CYCLES;
+    else
+        cpu->serial_cycles = 0;
+}
+
+// Counts down serial_cycles; update_timer only calls this while it is set
+void serial_update(CPU *cpu, __uint8_t t_cycles)
+{
+    if (cpu->serial_cycles > t_cycles)
+    {
+        cpu->serial_cycles -= t_cycles;
+        return;
+    }
+    cpu->serial_cycles = 0;
+    if ((cpu->memory[SC] & 0x81) == 0x81)
+        finish(cpu, exchange(cpu, cpu->memory[SB]));
+    else if (polling(cpu))
+    {
+        service(cpu->serial, false);
+        if (polling(cpu))
+            cpu->serial_cycles = SERIAL_POLL_CYCLES;
+    }
+}
+
+// Once a frame a socket link answers transfers even when the game isn't
+// waiting for one, so the other end never blocks for longer than a frame
+void serial_frame(Serial *serial)
+{
+    if (serial->link != SERIAL_SOCKET)
+        return;
+    service(serial, false);
+    if (polling(serial->cpu) && serial->cpu->serial_cycles == 0)
+        serial->cpu->serial_cycles = SERIAL_POLL_CYCLES;
+}
+
+void serial_report(Serial *serial, FILE *out)
+{
+    if (serial->link == SERIAL_UNPLUGGED && serial->clocked + serial->received == 0)
+        return;
+    if (serial->echo && serial->length && serial->output[serial->length - 1] != '\n')
+        fprintf(out, "\n");
+    fprintf(out, "Link: %lu transfers clocked, %lu received", serial->clocked, serial->received);
+    if (serial->peer)
+        fprintf(out, ", other machine caught up for %lu of them", serial->syncs);
+    if (serial->socket >= 0 || serial->wait_ns)
+        fprintf(out, ", %.1f ms waiting for the other end", serial->wait_ns / 1e6);
+    fprintf(out, "\n");
+}
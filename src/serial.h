@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+#include <stdio.h>
+#include "cpu.h"
+#define SB 0xFF01
+#define SC 0xFF02
+#define SERIAL_BIT_CYCLES 512 // the internal clock is 8192 Hz
+#define SERIAL_TRANSFER_CYCLES (8 * SERIAL_BIT_CYCLES)
+// How often a machine waiting for the other end's clock checks the socket
+#define SERIAL_POLL_CYCLES SERIAL_BIT_CYCLES
+
+// What is plugged into the link port. Whichever end clocks a transfer
+// (SC = 0x81) exchanges bytes when it completes, 8 bit times later; the
+// other end takes part if it is waiting on the external clock (SC = 0x80)
+// and shifts in 0xFF otherwise.
+typedef enum
+{
+    SERIAL_UNPLUGGED, // every transfer shifts in 0xFF
+    SERIAL_LOCAL,     // another machine in this process
+    SERIAL_SOCKET,    // another process on a Unix socket
+} SerialLink;
+
+typedef struct Serial
+{
+    CPU *cpu;
+    SerialLink link;
+    struct Serial *peer; // SERIAL_LOCAL
+    int socket;          // SERIAL_SOCKET
+    bool echo;           // copy the bytes sent to stdout
+    char *output;        // the bytes sent, NUL-terminated, for test ROMs
+    size_t length;
+    size_t capacity;
+    __uint64_t clocked;  // transfers this machine clocked
+    __uint64_t received; // transfers the other end clocked
+    __uint64_t syncs;    // times a local peer was run up to a transfer
+    __uint64_t wait_ns;  // waiting for the socket peer's reply
+} Serial;
+
+Serial *serial_init(CPU *cpu);
+void serial_free(Serial *serial);
+// Connects two machines in this process. The one that clocks a transfer
+// runs the other up to the transfer's end first if it is behind, so they
+// only synchronize around transfers. One that is ahead sees the transfer
+// late, so whatever runs the pair keeps them close together.
+void serial_link_local(Serial *a, Serial *b);
+// Either end of a socket link; listening waits for the other to connect
+void serial_listen(Serial *serial, const char *path);
+void serial_connect(Serial *serial, const char *path);
+void serial_write(CPU *cpu, __uint16_t address, __uint8_t value);
+void serial_update(CPU *cpu, __uint8_t t_cycles);
+void serial_frame(Serial *serial);
+void serial_report(Serial *serial, FILE *out);
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include "state.h"
+#include "memory.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct StateHeader
+{
+    char magic[8];
+    __uint32_t cpu_size; // sizeof(CPU), guards against loading another build's state
+    __uint32_t ram_size;
+    __uint64_t rom_hash;
+} StateHeader;
+
+// The mutable part of the Cartridge
+typedef struct CartridgeState
+{
+    __uint8_t rom_bank;
+    __uint8_t ram_bank;
+    bool ram_enabled;
+    bool banking_mode;
+} CartridgeState;
+
+static __uint64_t fnv(const __uint8_t *data, size_t size)
+{
+    __uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    return hash;
+}
+
+// Every save and load checks it, so it is computed once per cartridge
+__uint64_t state_rom_hash(CPU *cpu)
+{
+    Cartridge *cart = cpu->cartridge;
+    if (cart->rom_hash == 0)
+        cart->rom_hash = fnv(cart->rom_data, cart->rom_size);
+    return cart->rom_hash;
+}
+
+__uint64_t state_frame_hash(CPU *cpu)
+{
+    return fnv(cpu->ppu.frame, sizeof(cpu->ppu.frame));
+}
+
+size_t state_size(CPU *cpu)
+{
+    return sizeof(StateHeader) + sizeof(CPU) + sizeof(Fetcher) + sizeof(CartridgeState) + cpu->cartridge->ram_size;
+}
+
+void state_save(CPU *cpu, __uint8_t *out)
+{
+    Cartridge *cart = cpu->cartridge;
+    StateHeader header = {.cpu_size = sizeof(CPU), .ram_size = cart->ram_size, .rom_hash = state_rom_hash(cpu)};
+    CartridgeState cart_state = {cart->rom_bank, cart->ram_bank, cart->ram_enabled, cart->banking_mode};
+
+    memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, cpu, sizeof(CPU));
+    out += sizeof(CPU);
+    memcpy(out, cpu->fetcher, sizeof(Fetcher));
+    out += sizeof(Fetcher);
+    memcpy(out, &cart_state, sizeof(cart_state));
+    out += sizeof(cart_state);
+    if (cart->ram_size)
+        memcpy(out, cart->ram_data, cart->ram_size);
+}
+
+// False, leaving cpu untouched, when the state is from another build or ROM
+bool state_load(CPU *cpu, const __uint8_t *in, size_t size)
+{
+    Cartridge *cart = cpu->cartridge;
+    StateHeader header;
+
+    if (size != state_size(cpu))
+        return false;
+    memcpy(&header, in, sizeof(header));
+    if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0 || header.cpu_size != sizeof(CPU) ||
+        header.ram_size != cart->ram_size || header.rom_hash != state_rom_hash(cpu))
+        return false;
+    in += sizeof(header);
+
+    // Keep the host side of the CPU, take the machine from the state
+    Host host = CPU_host(cpu);
+    memcpy(cpu, in, sizeof(CPU));
+    in += sizeof(CPU);
+    CPU_set_host(cpu, &host);
+
+    memcpy(cpu->fetcher, in, sizeof(Fetcher));
+    in += sizeof(Fetcher);
+    CartridgeState cart_state;
+    memcpy(&cart_state, in, sizeof(cart_state));
+    in += sizeof(cart_state);
+    cart->rom_bank = cart_state.rom_bank;
+    cart->ram_bank = cart_state.ram_bank;
+    cart->ram_enabled = cart_state.ram_enabled;
+    cart->banking_mode = cart_state.banking_mode;
+    if (cart->ram_size)
+        memcpy(cart->ram_data, in, cart->ram_size);
+    return true;
+}
+
+void state_save_file(CPU *cpu, const char *path)
+{
+    size_t size = state_size(cpu);
+    __uint8_t *data = malloc(size);
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        perror("Error opening save state");
+        exit(1);
+    }
+    state_save(cpu, data);
+    if (fwrite(data, 1, size, file) != size)
+    {
+        perror("Error writing save state");
+        exit(1);
+    }
+    fclose(file);
+    free(data);
+}
+
+void state_load_file(CPU *cpu, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("Error opening save state");
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    __uint8_t *data = malloc(size);
+    if (fread(data, 1, size, file) != (size_t)size || !state_load(cpu, data, size))
+    {
+        printf("%s is not a save state of this ROM for this build\n", path);
+        exit(1);
+    }
+    fclose(file);
+    free(data);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+#define STATE_MAGIC "GBSTATE1"
+
+// Snapshot of everything the emulated machine is made of: the CPU struct
+// (registers, memory, PPU, APU), the fetcher, the cartridge's bank
+// registers and RAM. Host-side pointers (display, audio, JIT, ...) stay
+// with the running emulator. States are raw structs, so they only load
+// into the same build, and only for the ROM they were saved from.
+size_t state_size(CPU *cpu);
+void state_save(CPU *cpu, __uint8_t *out);
+bool state_load(CPU *cpu, const __uint8_t *in, size_t size);
+void state_save_file(CPU *cpu, const char *path);
+void state_load_file(CPU *cpu, const char *path);
+__uint64_t state_rom_hash(CPU *cpu);
+__uint64_t state_frame_hash(CPU *cpu);
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbols.h"
+
+// Local labels (Function.loop) are skipped so that lookups resolve to the
+// enclosing function. Banks are only kept for the switchable ROM window;
+// RGBDS numbers WRAM/HRAM sections too, but the DMG has one bank of each.
+
+static int region(__uint16_t address)
+{
+    return address < 0x4000 ? 0 : address < 0x8000 ? 1 : 2;
+}
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const Symbol *x = a;
+    const Symbol *y = b;
+    if (x->bank != y->bank)
+        return x->bank - y->bank;
+    return x->address - y->address;
+}
+
+Symbols *symbols_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    Symbols *symbols = calloc(1, sizeof(Symbols));
+    size_t capacity = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned int bank, address;
+        char name[256];
+        if (line[0] == ';' || sscanf(line, "%x:%x %255s", &bank, &address, name) != 3)
+            continue;
+        if (strchr(name, '.') || address > 0xFFFF)
+            continue;
+
+        if (symbols->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            symbols->symbols = realloc(symbols->symbols, capacity * sizeof(Symbol));
+        }
+        Symbol *symbol = &symbols->symbols[symbols->count++];
+        symbol->bank = region(address) == 1 ? bank : 0;
+        symbol->address = address;
+        symbol->name = strdup(name);
+    }
+    fclose(f);
+
+    qsort(symbols->symbols, symbols->count, sizeof(Symbol), compare_symbols);
+    return symbols;
+}
+
+// game.gb -> game.sym, next to the ROM
+Symbols *symbols_load_for_rom(const char *rom_path)
+{
+    size_t length = strlen(rom_path);
+    const char *dot = strrchr(rom_path, '.');
+    if (dot && strchr(dot, '/') == NULL)
+        length = dot - rom_path;
+
+    char *path = malloc(length + 5);
+    memcpy(path, rom_path, length);
+    strcpy(path + length, ".sym");
+    Symbols *symbols = symbols_load(path);
+    free(path);
+    return symbols;
+}
+
+void symbols_free(Symbols *symbols)
+{
+    if (symbols == NULL)
+        return;
+    for (size_t i = 0; i < symbols->count; i++)
+        free(symbols->symbols[i].name);
+    free(symbols->symbols);
+    free(symbols);
+}
+
+// Closest label at or below address in the same bank and memory region
+const Symbol *symbols_lookup(Symbols *symbols, __uint8_t bank, __uint16_t address)
+{
+    if (symbols == NULL || symbols->count == 0)
+        return NULL;
+
+    Symbol key = {bank, address, NULL};
+    size_t low = 0, high = symbols->count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (compare_symbols(&symbols->symbols[mid], &key) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0)
+        return NULL;
+
+    const Symbol *symbol = &symbols->symbols[low - 1];
+    if (symbol->bank != bank || region(symbol->address) != region(address))
+        return NULL;
+    return symbol;
+}
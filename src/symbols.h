@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+
+// Labels from an RGBDS .sym file ("BB:AAAA Name" per line)
+typedef struct Symbol
+{
+    __uint8_t bank; // 0 outside 0x4000-0x7FFF
+    __uint16_t address;
+    char *name;
+} Symbol;
+
+typedef struct Symbols
+{
+    Symbol *symbols; // sorted by bank, then address
+    size_t count;
+} Symbols;
+
+Symbols *symbols_load(const char *path);
+Symbols *symbols_load_for_rom(const char *rom_path);
+void symbols_free(Symbols *symbols);
+const Symbol *symbols_lookup(Symbols *symbols, __uint8_t bank, __uint16_t address);
@@ -1,8 +1,12 @@
 #include "timer.h"
 #include "ppu.h"
+#include "serial.h"
+#include "sections.h"
 
 void update_timer(CPU *cpu, __uint8_t t_cycles)
 {
+    SECTION_ENTER(SECTION_TIMER);
+    cpu->cycles += t_cycles;
     cpu->div_cycles += t_cycles;
     cpu->memory[DIV] = cpu->div_cycles >> 8;
 
@@ -41,5 +45,11 @@ void update_timer(CPU *cpu, __uint8_t t_cycles)
             }
         }
     }
+    if (cpu->serial_cycles)
+        serial_update(cpu, t_cycles);
+    SECTION_SWITCH(SECTION_APU);
+    update_apu(cpu, t_cycles);
+    SECTION_SWITCH(SECTION_PPU);
     update_ppu(cpu, t_cycles);
+    SECTION_LEAVE();
 }
@@ -0,0 +1,114 @@
+#include <sched.h>
+#include <time.h>
+#include "trace.h"
+#include "memory.h"
+#include "opcodes.h"
+
+// Records are appended from the emulation thread with no locks: the ring
+// is only blocked on when the writer thread falls a full ring behind, which
+// keeps the trace complete. Records are rendered as Gameboy Doctor text
+// offline by tools/trace2text.c.
+
+static void *writer_main(void *arg)
+{
+    Trace *trace = arg;
+    struct timespec idle = {0, 1000000};
+
+    for (;;)
+    {
+        __uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+        __uint64_t tail = trace->tail;
+        if (head == tail)
+        {
+            if (__atomic_load_n(&trace->closing, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE) == tail)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        // Up to the end of the ring, the rest goes out on the next pass
+        __uint64_t start = tail & (TRACE_RING_SIZE - 1);
+        __uint64_t count = head - tail;
+        if (count > TRACE_RING_SIZE - start)
+            count = TRACE_RING_SIZE - start;
+        if (count > TRACE_CHUNK)
+            count = TRACE_CHUNK;
+        if (fwrite(&trace->ring[start], sizeof(TraceRecord), count, trace->file) != count)
+        {
+            perror("Error writing trace");
+            exit(1);
+        }
+        __atomic_store_n(&trace->tail, tail + count, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+Trace *trace_open(CPU *cpu, const char *path)
+{
+    Trace *trace = calloc(1, sizeof(Trace));
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL)
+    {
+        perror("Error opening trace file");
+        exit(1);
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace->file);
+    trace->ring = malloc(TRACE_RING_SIZE * sizeof(TraceRecord));
+    if (trace->ring == NULL)
+    {
+        printf("Failed to allocate trace ring\n");
+        exit(1);
+    }
+    if (pthread_create(&trace->writer, NULL, writer_main, trace) != 0)
+    {
+        printf("Failed to start trace writer\n");
+        exit(1);
+    }
+
+    // Power-on state, like the first line of a Gameboy Doctor log
+    cpu->trace = trace;
+    trace_record(cpu);
+    return trace;
+}
+
+void trace_close(Trace *trace)
+{
+    if (trace == NULL)
+        return;
+    __atomic_store_n(&trace->closing, true, __ATOMIC_RELEASE);
+    pthread_join(trace->writer, NULL);
+    fclose(trace->file);
+    free(trace->ring);
+    free(trace);
+}
+
+void trace_record(CPU *cpu)
+{
+    Trace *trace = cpu->trace;
+    __uint64_t head = trace->head;
+
+    if (head - __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE)
+    {
+        trace->stalls++;
+        while (head - __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE)
+            sched_yield();
+    }
+
+    TraceRecord *r = &trace->ring[head & (TRACE_RING_SIZE - 1)];
+    r->A = cpu->registers.A;
+    r->F = get_F(cpu);
+    r->B = cpu->registers.B;
+    r->C = cpu->registers.C;
+    r->D = cpu->registers.D;
+    r->E = cpu->registers.E;
+    r->H = cpu->registers.H;
+    r->L = cpu->registers.L;
+    r->SP = cpu->SP;
+    r->PC = cpu->PC;
+    for (int i = 0; i < 4; i++)
+        r->pcmem[i] = read_memory(cpu, cpu->PC + i);
+
+    trace->records++;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <pthread.h>
+#include "cpu.h"
+#include "trace_format.h"
+#define TRACE_RING_SIZE (1 << 20) // records, power of two
+#define TRACE_CHUNK 4096          // records per fwrite
+
+// Instruction trace, built with `make TRACE=1`. Without TRACE the hook
+// compiles to nothing.
+#ifdef TRACE
+#define TRACE_INSTRUCTION(cpu) \
+    do { if ((cpu)->trace) trace_record(cpu); } while (0)
+#else
+#define TRACE_INSTRUCTION(cpu) ((void)0)
+#endif
+
+// Single-producer ring: the emulation thread appends records, a writer
+// thread drains them to the file
+typedef struct Trace
+{
+    TraceRecord *ring;
+    __uint64_t head; // written by the emulation thread
+    __uint64_t tail; // written by the writer thread
+    bool closing;
+    FILE *file;
+    pthread_t writer;
+    __uint64_t records;
+    __uint64_t stalls; // times the emulation thread waited for the writer
+} Trace;
+
+Trace *trace_open(CPU *cpu, const char *path);
+void trace_close(Trace *trace);
+void trace_record(CPU *cpu);
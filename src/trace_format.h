@@ -0,0 +1,30 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#define TRACE_MAGIC "GBTRACE1"
+#define TRACE_TEXT_LENGTH 74 // one Gameboy Doctor line, with newline
+
+// Binary trace file: TRACE_MAGIC, then one record per traced instruction.
+// Fields are stored in host byte order.
+typedef struct TraceRecord
+{
+    __uint8_t A;
+    __uint8_t F;
+    __uint8_t B;
+    __uint8_t C;
+    __uint8_t D;
+    __uint8_t E;
+    __uint8_t H;
+    __uint8_t L;
+    __uint16_t SP;
+    __uint16_t PC;
+    __uint8_t pcmem[4]; // bytes at PC..PC+3
+} TraceRecord;
+
+// Gameboy Doctor log line, the format print_cpu used to write
+static inline int trace_format(const TraceRecord *r, char *out)
+{
+    return sprintf(out, "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
+                   r->A, r->F, r->B, r->C, r->D, r->E, r->H, r->L, r->SP, r->PC,
+                   r->pcmem[0], r->pcmem[1], r->pcmem[2], r->pcmem[3]);
+}
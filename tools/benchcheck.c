@@ -0,0 +1,404 @@
+// Performance regression gate: benchcheck [options] BASELINE
+//   --runs N        run everything N times and compare the medians (default 5)
+//   --tolerance P   allowed slowdown in percent (default 10)
+//   --frames N      frames per workload ROM (default 600)
+//   --roms DIR      workload ROMs to run with emu --bench (default bench/roms)
+//   --update        write the medians to BASELINE instead of comparing
+//
+// Runs ./microbench --json and ./emu --bench on every ROM in DIR, takes the
+// median of every result over the runs and compares it to BASELINE, a flat
+// JSON object of name: value. Microbenchmarks are ns/op (lower is better),
+// "rom/NAME.mhz" the emulated MHz of a workload (higher is better) and
+// "rom/NAME.frame_hash" its last frame, which has to match exactly. Prints
+// a line per benchmark and exits 1 when anything got slower than the
+// tolerance allows or drew a different frame.
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define MAX_ENTRIES 256
+#define MAX_RUNS 64
+#define MICROBENCH_REPS 7 // per run, the runs supply the repetitions
+
+typedef struct Entry
+{
+    char name[64];
+    double values[MAX_RUNS];
+    int count;
+    char text[32]; // string values, frame hashes
+} Entry;
+
+typedef struct Results
+{
+    Entry entries[MAX_ENTRIES];
+    int count;
+} Results;
+
+// Depends on the SDL renderer and the host's graphics stack rather than on
+// our code, reported but never fails the check
+static const char *ungated[] = {"display_frame"};
+
+static Entry *find(Results *results, const char *name, bool create)
+{
+    for (int i = 0; i < results->count; i++)
+        if (strcmp(results->entries[i].name, name) == 0)
+            return &results->entries[i];
+    if (!create)
+        return NULL;
+    if (results->count == MAX_ENTRIES)
+    {
+        printf("Too many benchmarks\n");
+        exit(1);
+    }
+    Entry *entry = &results->entries[results->count++];
+    memset(entry, 0, sizeof(Entry));
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    return entry;
+}
+
+static void add_value(Results *results, const char *name, double value)
+{
+    Entry *entry = find(results, name, true);
+    if (entry->count < MAX_RUNS)
+        entry->values[entry->count++] = value;
+}
+
+// Sets a string result; a different string from an earlier run is kept as
+// "mismatch" so nondeterminism shows up as a failure
+static void add_text(Results *results, const char *name, const char *text)
+{
+    Entry *entry = find(results, name, true);
+    if (entry->text[0] && strcmp(entry->text, text) != 0)
+        text = "mismatch";
+    snprintf(entry->text, sizeof(entry->text), "%s", text);
+}
+
+// Adds every top-level "key": value of a JSON object to results; nested
+// objects and null are skipped
+static void parse_flat_json(const char *json, Results *results)
+{
+    const char *p = strchr(json, '{');
+    if (p == NULL)
+        return;
+    p++;
+    for (;;)
+    {
+        char key[64];
+        p = strchr(p, '"');
+        if (p == NULL)
+            return;
+        const char *end = strchr(p + 1, '"');
+        if (end == NULL || end - p - 1 >= (long)sizeof(key))
+            return;
+        memcpy(key, p + 1, end - p - 1);
+        key[end - p - 1] = 0;
+        p = strchr(end, ':');
+        if (p == NULL)
+            return;
+        p++;
+        while (*p == ' ' || *p == '\n')
+            p++;
+        if (*p == '"')
+        {
+            end = strchr(p + 1, '"');
+            if (end == NULL)
+                return;
+            char text[32];
+            int length = end - p - 1 < (long)sizeof(text) - 1 ? end - p - 1 : (int)sizeof(text) - 1;
+            memcpy(text, p + 1, length);
+            text[length] = 0;
+            add_text(results, key, text);
+            p = end + 1;
+        }
+        else if (*p == '{')
+        {
+            p = strchr(p, '}');
+            if (p == NULL)
+                return;
+            p++;
+        }
+        else if (strncmp(p, "null", 4) == 0)
+            p += 4;
+        else
+        {
+            char *number_end;
+            double value = strtod(p, &number_end);
+            if (number_end == p)
+                return;
+            add_value(results, key, value);
+            p = number_end;
+        }
+    }
+}
+
+static char *read_all(FILE *in)
+{
+    size_t size = 0, capacity = 4096;
+    char *text = malloc(capacity);
+    size_t n;
+    while ((n = fread(text + size, 1, capacity - size - 1, in)) > 0)
+    {
+        size += n;
+        if (size + 1 == capacity)
+            text = realloc(text, capacity *= 2);
+    }
+    text[size] = 0;
+    return text;
+}
+
+static char *run(const char *command)
+{
+    FILE *out = popen(command, "r");
+    if (out == NULL)
+    {
+        perror(command);
+        exit(1);
+    }
+    char *text = read_all(out);
+    if (pclose(out) != 0)
+    {
+        printf("Failed: %s\n", command);
+        exit(1);
+    }
+    return text;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(Entry *entry)
+{
+    qsort(entry->values, entry->count, sizeof(double), compare_double);
+    if (entry->count % 2)
+        return entry->values[entry->count / 2];
+    return (entry->values[entry->count / 2 - 1] + entry->values[entry->count / 2]) / 2;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// Workload ROM file names in dir without .gb, sorted, NULL-terminated
+static char **list_roms(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        perror(dir);
+        exit(1);
+    }
+    char **roms = calloc(MAX_ENTRIES + 1, sizeof(char *));
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL && count < MAX_ENTRIES)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 3 && strcmp(entry->d_name + length - 3, ".gb") == 0)
+            roms[count++] = strndup(entry->d_name, length - 3);
+    }
+    closedir(d);
+    qsort(roms, count, sizeof(char *), compare_names);
+    return roms;
+}
+
+static bool is_ungated(const char *name)
+{
+    for (size_t i = 0; i < sizeof(ungated) / sizeof(ungated[0]); i++)
+        if (strcmp(name, ungated[i]) == 0)
+            return true;
+    return false;
+}
+
+static bool higher_is_better(const char *name)
+{
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".mhz") == 0;
+}
+
+static void write_baseline(Results *results, const char *path)
+{
+    for (int i = 0; i < results->count; i++)
+    {
+        if (strcmp(results->entries[i].text, "mismatch") == 0)
+        {
+            printf("%s differs between runs, not writing a baseline\n", results->entries[i].name);
+            exit(1);
+        }
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fprintf(out, "{");
+    for (int i = 0; i < results->count; i++)
+    {
+        Entry *entry = &results->entries[i];
+        fprintf(out, "%s\n  \"%s\": ", i ? "," : "", entry->name);
+        if (entry->text[0])
+            fprintf(out, "\"%s\"", entry->text);
+        else
+            fprintf(out, "%.3f", median(entry));
+    }
+    fprintf(out, "\n}\n");
+    fclose(out);
+}
+
+// Prints the diff and returns the number of failures
+static int compare(Results *results, Results *baseline, double tolerance)
+{
+    int failures = 0;
+
+    printf("%-26s %12s %12s %8s\n", "benchmark", "baseline", "median", "change");
+    for (int i = 0; i < results->count; i++)
+    {
+        Entry *entry = &results->entries[i];
+        Entry *base = find(baseline, entry->name, false);
+        if (entry->text[0])
+        {
+            bool same = base && strcmp(base->text, entry->text) == 0;
+            printf("%-26s %s\n", entry->name, same ? "same" : "DIFFERENT");
+            if (!same)
+                printf("%-26s   baseline %s, now %s\n", "", base ? base->text : "none", entry->text);
+            failures += !same;
+            continue;
+        }
+        double now = median(entry);
+        if (base == NULL || base->count == 0)
+        {
+            printf("%-26s %12s %12.3f %8s   new\n", entry->name, "-", now, "");
+            continue;
+        }
+        double was = base->values[0];
+        double change = was ? (now - was) * 100 / was : 0;
+        double slowdown = higher_is_better(entry->name) ? -change : change;
+        const char *status = "";
+        if (is_ungated(entry->name))
+            status = "   not gated";
+        else if (slowdown > tolerance)
+        {
+            status = "   REGRESSED";
+            failures++;
+        }
+        else if (slowdown < -tolerance)
+            status = "   faster";
+        printf("%-26s %12.3f %12.3f %+7.1f%%%s\n", entry->name, was, now, change, status);
+    }
+    for (int i = 0; i < baseline->count; i++)
+    {
+        const char *name = baseline->entries[i].name;
+        if (find(results, name, false) != NULL)
+            continue;
+        if (is_ungated(name))
+            printf("%-26s missing from this run   not gated\n", name);
+        else
+        {
+            printf("%-26s missing from this run\n", name);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5;
+    double tolerance = 10;
+    int frames = 600;
+    const char *roms_dir = "bench/roms";
+    bool update = false;
+    const char *baseline_path = NULL;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roms") == 0 && i + 1 < argc)
+            roms_dir = argv[++i];
+        else if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (argv[i][0] != '-' && baseline_path == NULL)
+            baseline_path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || baseline_path == NULL || runs < 1 || runs > MAX_RUNS || frames < 1)
+    {
+        printf("Usage: %s [--runs N] [--tolerance PERCENT] [--frames N] [--roms DIR] [--update] BASELINE\n", argv[0]);
+        return 2;
+    }
+
+    static Results results;
+    char **roms = list_roms(roms_dir);
+    char command[4096];
+    for (int r = 0; r < runs; r++)
+    {
+        fprintf(stderr, "run %d/%d\n", r + 1, runs);
+        snprintf(command, sizeof(command), "./microbench --json --reps %d", MICROBENCH_REPS);
+        char *output = run(command);
+        parse_flat_json(output, &results);
+        free(output);
+        for (char **rom = roms; *rom; rom++)
+        {
+            static Results report;
+            char name[96];
+            Entry *entry;
+
+            report.count = 0;
+            snprintf(command, sizeof(command), "./emu --bench --frames %d '%s/%s.gb' 2>/dev/null", frames, roms_dir, *rom);
+            output = run(command);
+            parse_flat_json(output, &report);
+            free(output);
+            if ((entry = find(&report, "emulated_mhz", false)) && entry->count)
+            {
+                snprintf(name, sizeof(name), "rom/%s.mhz", *rom);
+                add_value(&results, name, entry->values[0]);
+            }
+            if ((entry = find(&report, "frame_hash", false)))
+            {
+                snprintf(name, sizeof(name), "rom/%s.frame_hash", *rom);
+                add_text(&results, name, entry->text);
+            }
+        }
+    }
+
+    if (update)
+    {
+        write_baseline(&results, baseline_path);
+        printf("Wrote %d benchmarks, medians of %d runs, to %s\n", results.count, runs, baseline_path);
+        return 0;
+    }
+
+    static Results baseline;
+    FILE *in = fopen(baseline_path, "r");
+    if (in == NULL)
+    {
+        perror(baseline_path);
+        return 1;
+    }
+    char *text = read_all(in);
+    fclose(in);
+    parse_flat_json(text, &baseline);
+    free(text);
+
+    int failures = compare(&results, &baseline, tolerance);
+    printf("Medians of %d runs against %s, tolerance %.1f%%: ", runs, baseline_path, tolerance);
+    if (failures)
+    {
+        printf("%d failed\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Measures what emu --run-ahead does to input lag and what it costs:
+//   inputlag [--max-ahead K] [--press FRAME] [--frames N] [--buttons MASK]
+//            [--joypad] ROM
+//
+// For every run-ahead from 0 to K frames (default 3) the ROM runs headless
+// for N host frames (default 600) from power-on, twice: once without input
+// and once with MASK (cpu->buttons bits, default 0xFF: all of them) held
+// from host frame FRAME (default 120) on. The lag is how many host frames
+// after the press the first shown frame that differs between the two runs
+// comes: 0 when the frame shown for the press already does. Each frame of
+// lag is 16.7 ms more from pressing a button to seeing it.
+//
+// The press goes straight into cpu->buttons, the input the real frame runs
+// with, so the lag is the game's own. With --joypad it goes in as
+// cpu->host_buttons, through joypad_frame like keys on the keyboard: they
+// are sampled at the end of a frame for the next one, a frame later.
+//
+// The cost is the emulation time per host frame of the run with the press,
+// and how much each frame ahead adds to it over no run-ahead.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "runahead.h"
+#define FRAME_MS (70224 * 1000.0 / 4194304)
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct Run
+{
+    __uint64_t *shown; // hash of the frame shown, per host frame
+    double frame_us;   // per host frame
+} Run;
+
+static __uint64_t fnv(const __uint8_t *data, size_t length)
+{
+    __uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    return hash;
+}
+
+static void run(const char *filename, int ahead, int frames, int press, __uint8_t buttons, bool joypad, Run *out)
+{
+    CPU *cpu = calloc(1, sizeof(CPU));
+    Fetcher *fetcher = calloc(1, sizeof(Fetcher));
+
+    CPU_init(cpu, fetcher, filename, NULL);
+    RunAhead *runahead = runahead_init(cpu, ahead);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        // Headless, joypad_frame takes cpu->host_buttons
+        if (frame >= press && joypad)
+            cpu->host_buttons = buttons;
+        else if (frame >= press)
+            cpu->buttons = buttons;
+        runahead_frame(runahead);
+        out->shown[frame] = fnv(runahead->frame, sizeof(runahead->frame));
+    }
+    out->frame_us = (runahead->real_ns + runahead->ahead_ns) / 1e3 / frames;
+    runahead_free(runahead);
+    free(fetcher);
+    free(cpu);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    int max_ahead = 3;
+    int press = 120;
+    int frames = 600;
+    int buttons = 0xFF;
+    bool joypad = false;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-ahead") == 0 && i + 1 < argc)
+            max_ahead = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--press") == 0 && i + 1 < argc)
+            press = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--buttons") == 0 && i + 1 < argc)
+            buttons = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--joypad") == 0)
+            joypad = true;
+        else if (filename == NULL)
+            filename = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || filename == NULL || max_ahead < 0 || max_ahead > RUNAHEAD_MAX_FRAMES || press < 0 ||
+        press >= frames || buttons <= 0 || buttons > 0xFF)
+    {
+        printf("Usage: inputlag [--max-ahead 0-%d] [--press FRAME] [--frames N] [--buttons MASK] [--joypad] ROM\n"
+               "FRAME must be below N\n",
+               RUNAHEAD_MAX_FRAMES);
+        return 1;
+    }
+
+    Run idle = {.shown = calloc(frames, sizeof(__uint64_t))};
+    Run pressed = {.shown = calloc(frames, sizeof(__uint64_t))};
+    double base_us = 0;
+
+    printf("%s: buttons %02x pressed at host frame %d of %d%s\n", filename, buttons, press, frames,
+           joypad ? ", through joypad_frame" : "");
+    printf("ahead  lag (frames)  lag (ms)  host frame (us)  per frame ahead (us)\n");
+    for (int ahead = 0; ahead <= max_ahead; ahead++)
+    {
+        run(filename, ahead, frames, frames, 0, joypad, &idle);
+        run(filename, ahead, frames, press, buttons, joypad, &pressed);
+        int frame = press;
+        while (frame < frames && pressed.shown[frame] == idle.shown[frame])
+            frame++;
+        if (ahead == 0)
+            base_us = pressed.frame_us;
+        printf("%5d  ", ahead);
+        if (frame < frames)
+            printf("%12d  %8.1f", frame - press, (frame - press) * FRAME_MS);
+        else
+            printf("%12s  %8s", "none", "-");
+        printf("  %15.1f", pressed.frame_us);
+        if (ahead)
+            printf("  %20.1f", (pressed.frame_us - base_us) / ahead);
+        printf("\n");
+    }
+    free(idle.shown);
+    free(pressed.shown);
+    return 0;
+}
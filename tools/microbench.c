@@ -0,0 +1,465 @@
+// Microbenchmarks for the emulator's hot paths, each run in isolation on a
+// synthetic machine: microbench [--json] [--reps N] [FILTER]
+//
+// Every benchmark is warmed up, then its batch size is calibrated so one
+// batch takes about BATCH_MS, and it is timed over REPETITIONS batches.
+// The report is the median ns per operation and the median absolute
+// deviation as a percentage of it; a benchmark whose spread is above
+// UNSTABLE_PERCENT is marked, its number shouldn't be trusted. Only
+// benchmarks whose name contains FILTER are run. --json writes
+// {"name": ns_per_op, ...} to stdout for scripts.
+//
+// Times are thread CPU time, so time the host gives to other processes
+// isn't counted. The functions measured are the emulator's own objects,
+// built with the same CFLAGS as emu.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "cpu.h"
+#include "memory.h"
+#include "ppu.h"
+#include "timer.h"
+#define REPETITIONS 21
+#define WARMUP_MS 50
+#define BATCH_MS 10
+#define UNSTABLE_PERCENT 5.0
+#define ROM_BANKS 32
+#define RAM_SIZE (32 * 1024)
+
+typedef struct Benchmark
+{
+    const char *name;
+    void (*setup)(CPU *cpu, int arg);
+    void (*run)(CPU *cpu, __uint64_t ops, int arg);
+    int arg;
+} Benchmark;
+
+static volatile __uint8_t sink;
+static Fetcher fetcher;
+static SDL_Renderer *renderer;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A machine with a ROM_BANKS bank cartridge of the given type and the LCD
+// off, so nothing but the code under test does any work
+static void reset_machine(CPU *cpu, CartridgeType type)
+{
+    Cartridge *cart = cpu->cartridge;
+
+    memset(cart->rom_data, 0, cart->rom_size);
+    memset(cart->ram_data, 0, cart->ram_size);
+    cart->type = type;
+    cart->rom_bank = 1;
+    cart->ram_bank = 0;
+    cart->ram_enabled = true;
+    cart->banking_mode = false;
+
+    Cartridge *keep = cpu->cartridge;
+    memset(cpu, 0, sizeof(CPU));
+    memset(&fetcher, 0, sizeof(fetcher));
+    cpu->cartridge = keep;
+    cpu->fetcher = &fetcher;
+    cpu->SP = 0xFFFE;
+    cpu->PC = 0x100;
+    cpu->memory[IO_JOYPAD] = 0xFF;
+    cpu->memory[BGP] = 0xE4;
+    cpu->memory[OBP0] = 0xE4;
+    cpu->memory[OBP1] = 0x1B;
+    cpu->ppu.prev_ly = 0xFF;
+    apu_init(cpu);
+}
+
+// Memory access
+
+static const __uint16_t region_base[] = {0x0000, 0x4000, 0x8000, 0xA000, 0xC000, 0xFE00, 0xFF10, 0xFF80};
+enum
+{
+    REGION_ROM0,
+    REGION_ROMX,
+    REGION_VRAM,
+    REGION_SRAM,
+    REGION_WRAM,
+    REGION_OAM,
+    REGION_APU,
+    REGION_HRAM,
+    REGION_MBC, // writes only: bank and RAM enable registers
+};
+
+static void setup_rom_only(CPU *cpu, int region)
+{
+    reset_machine(cpu, ROM_ONLY);
+    (void)region;
+}
+
+static void setup_mbc1(CPU *cpu, int region)
+{
+    reset_machine(cpu, MBC1);
+    (void)region;
+}
+
+// 16 addresses spread over the region so the access isn't a constant
+static __uint16_t region_address(int region, __uint64_t i)
+{
+    if (region == REGION_APU)
+        return region_base[region] + (i & 0x0F);
+    return region_base[region] + ((i * 97) & 0x7F);
+}
+
+static void run_read(CPU *cpu, __uint64_t ops, int region)
+{
+    __uint8_t acc = 0;
+    for (__uint64_t i = 0; i < ops; i++)
+        acc ^= read_memory(cpu, region_address(region, i));
+    sink = acc;
+}
+
+static void run_write(CPU *cpu, __uint64_t ops, int region)
+{
+    if (region == REGION_MBC)
+    {
+        // rom bank select, then RAM enable, as bank switching code does
+        for (__uint64_t i = 0; i < ops; i += 2)
+        {
+            write_memory(cpu, 0x2000, i & 0x1F);
+            write_memory(cpu, 0x0000, 0x0A);
+        }
+        return;
+    }
+    for (__uint64_t i = 0; i < ops; i++)
+        write_memory(cpu, region_address(region, i), i);
+}
+
+// CPU_step on instruction streams that fill the ROM from 0x100 and jump
+// back to it at the end, so branches are the stream's own
+
+static const __uint8_t stream_nop[] = {0x00};
+static const __uint8_t stream_alu[] = {0x80, 0xA9, 0x3C, 0x92, 0xB3, 0x0D, 0x2F, 0xC6, 0x11};
+static const __uint8_t stream_hl[] = {0x7E, 0x34, 0x77, 0x2C, 0x86, 0x35};
+static const __uint8_t stream_ld16[] = {0x21, 0x00, 0xC0, 0x11, 0x00, 0xC1, 0x2A, 0x12, 0x13, 0x03};
+static const __uint8_t stream_cb[] = {0xCB, 0x37, 0xCB, 0x11, 0xCB, 0x7E, 0xCB, 0xC6, 0xCB, 0x3A};
+static const __uint8_t stream_branch[] = {0x18, 0x00, 0x20, 0x00, 0xCD, 0x00, 0x01}; // calls a RET at 0x100
+static const __uint8_t stream_push[] = {0xC5, 0xD5, 0xD1, 0xC1, 0xF5, 0xF1};
+
+static const struct
+{
+    const __uint8_t *code;
+    size_t size;
+} streams[] = {
+    {stream_nop, sizeof(stream_nop)},
+    {stream_alu, sizeof(stream_alu)},
+    {stream_hl, sizeof(stream_hl)},
+    {stream_ld16, sizeof(stream_ld16)},
+    {stream_cb, sizeof(stream_cb)},
+    {stream_branch, sizeof(stream_branch)},
+    {stream_push, sizeof(stream_push)},
+};
+
+static void setup_stream(CPU *cpu, int stream)
+{
+    reset_machine(cpu, ROM_ONLY);
+    __uint8_t *rom = cpu->cartridge->rom_data;
+    const __uint8_t *code = streams[stream].code;
+    size_t size = streams[stream].size;
+    size_t end = 0x7FF0 - size;
+    size_t pc = 0x100;
+
+    if (code == stream_branch)
+    {
+        rom[0x100] = 0xC9; // ret
+        pc = 0x101;
+    }
+    for (; pc < end; pc += size)
+        memcpy(rom + pc, code, size);
+    rom[pc] = 0xC3; // jp back to the start
+    rom[pc + 1] = code == stream_branch ? 0x01 : 0x00;
+    rom[pc + 2] = 0x01;
+    cpu->PC = code == stream_branch ? 0x101 : 0x100;
+    cpu->registers.H = 0xC0; // (HL) in WRAM
+    cpu->SP = 0xDFFE;
+}
+
+static void run_stream(CPU *cpu, __uint64_t ops, int stream)
+{
+    (void)stream;
+    for (__uint64_t i = 0; i < ops; i++)
+        CPU_step(cpu);
+}
+
+// PPU
+
+static void fill_vram(CPU *cpu)
+{
+    for (int i = 0; i < 0x1800; i++)
+        cpu->memory[0x8000 + i] = (i * 37) ^ (i >> 3);
+    for (int i = 0; i < 0x800; i++)
+        cpu->memory[0x9800 + i] = i * 7;
+}
+
+// The first visible 8x16 sprites cover lines 0-15, the rest are off screen
+static void place_sprites(CPU *cpu, int visible)
+{
+    for (int i = 0; i < 40; i++)
+    {
+        __uint8_t *oam = &cpu->memory[OAM_ADDR + i * 4];
+        oam[0] = i < visible ? 16 : 0;
+        oam[1] = 8 + (i % 10) * 16;
+        oam[2] = i;
+        oam[3] = (i & 1) << 4;
+    }
+}
+
+static void setup_oam(CPU *cpu, int visible)
+{
+    reset_machine(cpu, ROM_ONLY);
+    cpu->memory[LCDC] = 0x97;
+    place_sprites(cpu, visible);
+}
+
+static void run_oam(CPU *cpu, __uint64_t ops, int visible)
+{
+    (void)visible;
+    for (__uint64_t i = 0; i < ops; i++)
+    {
+        cpu->memory[LY] = i & 0x0F;
+        cpu->ppu.sprite_buffer.size = 0;
+        oam_scan(cpu);
+    }
+}
+
+enum
+{
+    SCENE_BG,
+    SCENE_WINDOW,
+    SCENE_SPRITES,
+};
+
+static void setup_scene(CPU *cpu, int scene)
+{
+    reset_machine(cpu, ROM_ONLY);
+    fill_vram(cpu);
+    cpu->memory[LCDC] = 0x93 | (scene == SCENE_WINDOW ? 0x60 : 0) | (scene == SCENE_SPRITES ? 0x04 : 0);
+    cpu->memory[SCX] = 3;
+    cpu->memory[WX] = 87; // window covers the right half
+    if (scene == SCENE_SPRITES)
+        place_sprites(cpu, 40);
+}
+
+// One line: what update_ppu does from the OAM scan to the end of mode 3
+static void run_scanline(CPU *cpu, __uint64_t ops, int scene)
+{
+    __uint8_t wx = cpu->memory[WX];
+
+    for (__uint64_t i = 0; i < ops; i++)
+    {
+        // the sprite scene stays on the lines its sprites cover
+        cpu->memory[LY] = scene == SCENE_SPRITES ? i & 0x0F : (i * 7) % 144;
+        cpu->ppu.sprite_buffer.size = 0;
+        cpu->ppu.bg_queue.size = 0;
+        cpu->ppu.sprite_queue.size = 0;
+        if (scene == SCENE_SPRITES)
+            oam_scan(cpu);
+        fetcher.curr_p = 0;
+        fetcher.x_offset = 0;
+        fetcher.fetching_window_pixels = false;
+        while (fetcher.curr_p < 160)
+        {
+            if (scene == SCENE_WINDOW && wx - 7 <= fetcher.curr_p && !fetcher.fetching_window_pixels)
+            {
+                fetcher.x_offset = 0;
+                fetcher.fetching_window_pixels = true;
+            }
+            render_scanline(cpu, &fetcher, cpu->memory[LY]);
+        }
+    }
+}
+
+// Timer
+
+static void setup_timer(CPU *cpu, int tac)
+{
+    reset_machine(cpu, ROM_ONLY);
+    cpu->memory[TAC] = tac;
+}
+
+// update_timer also ticks the APU and the PPU, which with the LCD off and
+// no sound output only check whether they have anything to do
+static void run_timer(CPU *cpu, __uint64_t ops, int tac)
+{
+    (void)tac;
+    for (__uint64_t i = 0; i < ops; i++)
+        update_timer(cpu, 4);
+}
+
+// Display
+
+static void setup_display(CPU *cpu, int arg)
+{
+    setup_scene(cpu, SCENE_BG);
+    for (int ly = 0; ly < 144; ly++)
+        for (int x = 0; x < 160; x++)
+            cpu->ppu.frame[ly * 160 + x] = (x / 8 + ly / 8 + arg) & 3;
+}
+
+static void run_display(CPU *cpu, __uint64_t ops, int arg)
+{
+    (void)arg;
+    for (__uint64_t i = 0; i < ops; i++)
+        display_frame(NULL, renderer, cpu->ppu.frame);
+}
+
+static const Benchmark benchmarks[] = {
+    {"read/rom0", setup_rom_only, run_read, REGION_ROM0},
+    {"read/romx/rom_only", setup_rom_only, run_read, REGION_ROMX},
+    {"read/romx/mbc1", setup_mbc1, run_read, REGION_ROMX},
+    {"read/sram/rom_only", setup_rom_only, run_read, REGION_SRAM},
+    {"read/sram/mbc1", setup_mbc1, run_read, REGION_SRAM},
+    {"read/vram", setup_rom_only, run_read, REGION_VRAM},
+    {"read/wram", setup_rom_only, run_read, REGION_WRAM},
+    {"read/oam", setup_rom_only, run_read, REGION_OAM},
+    {"read/apu", setup_rom_only, run_read, REGION_APU},
+    {"read/hram", setup_rom_only, run_read, REGION_HRAM},
+    {"write/mbc/rom_only", setup_rom_only, run_write, REGION_MBC},
+    {"write/mbc/mbc1", setup_mbc1, run_write, REGION_MBC},
+    {"write/sram/mbc1", setup_mbc1, run_write, REGION_SRAM},
+    {"write/vram", setup_rom_only, run_write, REGION_VRAM},
+    {"write/wram", setup_rom_only, run_write, REGION_WRAM},
+    {"write/oam", setup_rom_only, run_write, REGION_OAM},
+    {"write/apu", setup_rom_only, run_write, REGION_APU},
+    {"write/hram", setup_rom_only, run_write, REGION_HRAM},
+    {"step/nop", setup_stream, run_stream, 0},
+    {"step/alu", setup_stream, run_stream, 1},
+    {"step/hl", setup_stream, run_stream, 2},
+    {"step/ld16", setup_stream, run_stream, 3},
+    {"step/cb", setup_stream, run_stream, 4},
+    {"step/branch", setup_stream, run_stream, 5},
+    {"step/push_pop", setup_stream, run_stream, 6},
+    {"scanline/bg", setup_scene, run_scanline, SCENE_BG},
+    {"scanline/window", setup_scene, run_scanline, SCENE_WINDOW},
+    {"scanline/sprites", setup_scene, run_scanline, SCENE_SPRITES},
+    {"oam_scan/0", setup_oam, run_oam, 0},
+    {"oam_scan/10", setup_oam, run_oam, 10},
+    {"oam_scan/40", setup_oam, run_oam, 40},
+    {"timer/off", setup_timer, run_timer, 0x00},
+    {"timer/4096hz", setup_timer, run_timer, 0x04},
+    {"timer/262144hz", setup_timer, run_timer, 0x05},
+    {"timer/65536hz", setup_timer, run_timer, 0x06},
+    {"timer/16384hz", setup_timer, run_timer, 0x07},
+    {"display_frame", setup_display, run_display, 0},
+};
+
+static double batch_seconds(CPU *cpu, const Benchmark *b, __uint64_t ops)
+{
+    double start = now();
+    b->run(cpu, ops, b->arg);
+    return now() - start;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Median ns/op over repetitions batches, and the spread in percent
+static double measure(CPU *cpu, const Benchmark *b, int repetitions, double *spread)
+{
+    double samples[repetitions];
+    double deviations[repetitions];
+    __uint64_t ops = 1;
+
+    b->setup(cpu, b->arg);
+    // grow the batch until it takes BATCH_MS, which also warms up
+    double seconds;
+    while ((seconds = batch_seconds(cpu, b, ops)) < BATCH_MS / 1e3 && ops < (1ULL << 40))
+        ops *= 2;
+    ops = ops * (BATCH_MS / 1e3) / seconds + 1;
+    for (double start = now(); now() - start < WARMUP_MS / 1e3;)
+        b->run(cpu, ops, b->arg);
+
+    for (int i = 0; i < repetitions; i++)
+        samples[i] = batch_seconds(cpu, b, ops) * 1e9 / ops;
+    qsort(samples, repetitions, sizeof(double), compare_double);
+    double median = samples[repetitions / 2];
+    for (int i = 0; i < repetitions; i++)
+        deviations[i] = samples[i] > median ? samples[i] - median : median - samples[i];
+    qsort(deviations, repetitions, sizeof(double), compare_double);
+    *spread = median > 0 ? deviations[repetitions / 2] * 100 / median : 0;
+    return median;
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    int repetitions = REPETITIONS;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+            repetitions = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && filter == NULL)
+            filter = argv[i];
+        else
+        {
+            printf("Usage: %s [--json] [--reps N] [FILTER]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repetitions < 1)
+        repetitions = 1;
+
+    CPU *cpu = calloc(1, sizeof(CPU));
+    Cartridge *cart = calloc(1, sizeof(Cartridge));
+    cart->rom_size = ROM_BANKS * 0x4000;
+    cart->rom_data = calloc(1, cart->rom_size);
+    cart->ram_size = RAM_SIZE;
+    cart->ram_data = calloc(1, cart->ram_size);
+    cpu->cartridge = cart;
+
+    // display_frame draws into memory, no window needed
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, WINDOW_WIDTH, WINDOW_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (surface)
+        renderer = SDL_CreateSoftwareRenderer(surface);
+
+    if (json)
+        printf("{");
+    else
+        printf("%-22s %12s %8s   (median of %d)\n", "benchmark", "ns/op", "spread", repetitions);
+    int printed = 0;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        const Benchmark *b = &benchmarks[i];
+        if (filter && strstr(b->name, filter) == NULL)
+            continue;
+        if (b->run == run_display && renderer == NULL)
+        {
+            fprintf(stderr, "%s skipped: no software renderer (%s)\n", b->name, SDL_GetError());
+            continue;
+        }
+        double spread;
+        double ns = measure(cpu, b, repetitions, &spread);
+        if (json)
+            printf("%s\n  \"%s\": %.3f", printed ? "," : "", b->name, ns);
+        else
+            printf("%-22s %12.2f %7.1f%%%s\n", b->name, ns, spread, spread > UNSTABLE_PERCENT ? "   unstable" : "");
+        fflush(stdout);
+        printed++;
+    }
+    if (json)
+        printf("\n}\n");
+
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+    if (surface)
+        SDL_FreeSurface(surface);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Stand-in remote player for emu --rollback:
+//   netpeer [--delay FRAMES] [--jitter FRAMES] [--seed N] PATH
+//
+// Listens on the Unix socket PATH for one emulator. For every frame the
+// emulator sends, it answers with its own input up to DELAY frames earlier,
+// plus up to JITTER more chosen at random each time, so the emulator is
+// always running ahead of the remote input and has to predict it. The input
+// is a seeded pseudo-random player that holds a button or two for a few
+// frames at a time: the same seed gives the same input whatever the delay,
+// so the emulator's final frame hash must not depend on the delay either.
+// Prints the frames played and a hash of the input when the emulator is
+// done.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "rollback_format.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct Player
+{
+    __uint64_t rng;
+    __uint8_t buttons;
+    int hold; // frames left before the buttons change
+} Player;
+
+static __uint64_t next(__uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// The buttons for the next frame
+static __uint8_t play(Player *player)
+{
+    if (player->hold-- <= 0)
+    {
+        __uint64_t r = next(&player->rng);
+        player->buttons = (r & 3) ? (1 << (r >> 8) % 8) | ((r & 1) ? 1 << (r >> 16) % 8 : 0) : 0;
+        player->hold = 1 + (r >> 24) % 20;
+    }
+    return player->buttons;
+}
+
+int main(int argc, char **argv)
+{
+    int delay = 4;
+    int jitter = 0;
+    __uint64_t seed = 1;
+    const char *path = NULL;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc)
+            delay = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc)
+            jitter = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (argv[i][0] != '-' && path == NULL)
+            path = argv[i];
+        else
+            usage = true;
+    }
+    struct sockaddr_un address = {0};
+    if (usage || path == NULL || delay < 0 || jitter < 0 || seed == 0 || strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("Usage: %s [--delay FRAMES] [--jitter FRAMES] [--seed N] PATH\n", argv[0]);
+        return 2;
+    }
+
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    close(listener);
+    unlink(path);
+
+    Player player = {seed, 0, 0};
+    __uint64_t jitter_rng = seed ^ 0x9E3779B97F4A7C15ULL;
+    __uint64_t sent = 0; // frames whose input went out
+    __uint64_t hash = FNV_OFFSET;
+    RollbackMessage message;
+    while (recv(fd, &message, sizeof(message), MSG_WAITALL) == sizeof(message))
+    {
+        __int64_t until = message.frame; // send the input of frames up to this one
+        if (message.type == ROLLBACK_INPUT)
+            until -= delay + (jitter ? next(&jitter_rng) % (jitter + 1) : 0);
+        for (; (__int64_t)sent <= until; sent++)
+        {
+            RollbackMessage input = {sent, ROLLBACK_INPUT, play(&player), 0};
+            hash = (hash ^ input.buttons) * FNV_PRIME;
+            if (send(fd, &input, sizeof(input), MSG_NOSIGNAL) != sizeof(input))
+            {
+                perror("send");
+                return 1;
+            }
+        }
+    }
+    printf("netpeer: %lu frames of input, hash %016lx\n", sent, hash);
+    close(fd);
+    return 0;
+}
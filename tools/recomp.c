@@ -0,0 +1,610 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Ahead-of-time recompiler: disassembles a ROM from its entry points,
+// follows every statically known JP/JR/CALL/RST target and emits a C file
+// that defines recomp_run (see src/recomp.h). Each instruction becomes a
+// direct call to the same handler exec_opcode would use, so timing and
+// side effects are identical; only fetch/decode is gone. Between two
+// instructions it does what CPU_start would: it returns to it at a frame or
+// cycle limit or during OAM DMA, updates the joypad and ticks the sampler,
+// so a native run stops and hashes like the interpreter. Code reached only
+// through JP HL/RET, or running from RAM, stays on the interpreter.
+//
+// Usage: recomp rom.gb out.c
+
+#define SLOT_SIZE 0x4000
+#define VISITED 0x01
+#define MAX_STACK (1 << 20)
+
+typedef struct Opcode
+{
+    const char *mnemonic;
+    const char *call; // handler call, as in exec_opcode
+    __uint8_t length;
+} Opcode;
+
+static const Opcode opcodes[256] = {
+    /* 0x00 */ {"NOP", "NOP(cpu)", 1},
+    /* 0x01 */ {"LD BC, n16", "LD_BC_n16(cpu)", 3},
+    /* 0x02 */ {"LD [BC], A", "LD_r16_A(cpu, get_BC(cpu))", 1},
+    /* 0x03 */ {"INC BC", "INC_BC(cpu)", 1},
+    /* 0x04 */ {"INC B", "INC_r8(cpu, &cpu->registers.B)", 1},
+    /* 0x05 */ {"DEC B", "DEC_r8(cpu, &cpu->registers.B)", 1},
+    /* 0x06 */ {"LD B, n8", "LD_r8_n8(cpu, &cpu->registers.B)", 2},
+    /* 0x07 */ {"RLCA", "RLCA(cpu)", 1},
+    /* 0x08 */ {"LD [a16], SP", "LD_a16_SP(cpu)", 3},
+    /* 0x09 */ {"ADD HL, BC", "ADD_HL_r16(cpu, get_BC(cpu))", 1},
+    /* 0x0A */ {"LD A, [BC]", "LD_A_r16(cpu, get_BC(cpu))", 1},
+    /* 0x0B */ {"DEC BC", "DEC_BC(cpu)", 1},
+    /* 0x0C */ {"INC C", "INC_r8(cpu, &cpu->registers.C)", 1},
+    /* 0x0D */ {"DEC C", "DEC_r8(cpu, &cpu->registers.C)", 1},
+    /* 0x0E */ {"LD C, n8", "LD_r8_n8(cpu, &cpu->registers.C)", 2},
+    /* 0x0F */ {"RRCA", "RRCA(cpu)", 1},
+    /* 0x10 */ {"STOP", "STOP(cpu)", 1},
+    /* 0x11 */ {"LD DE, n16", "LD_DE_n16(cpu)", 3},
+    /* 0x12 */ {"LD [DE], A", "LD_DE_A(cpu)", 1},
+    /* 0x13 */ {"INC DE", "INC_DE(cpu)", 1},
+    /* 0x14 */ {"INC D", "INC_r8(cpu, &cpu->registers.D)", 1},
+    /* 0x15 */ {"DEC D", "DEC_r8(cpu, &cpu->registers.D)", 1},
+    /* 0x16 */ {"LD D, n8", "LD_r8_n8(cpu, &cpu->registers.D)", 2},
+    /* 0x17 */ {"RLA", "RLA(cpu)", 1},
+    /* 0x18 */ {"JR e8", "JR_n16(cpu)", 2},
+    /* 0x19 */ {"ADD HL, DE", "ADD_HL_r16(cpu, get_DE(cpu))", 1},
+    /* 0x1A */ {"LD A, [DE]", "LD_A_DE(cpu)", 1},
+    /* 0x1B */ {"DEC DE", "DEC_DE_r16(cpu)", 1},
+    /* 0x1C */ {"INC E", "INC_r8(cpu, &cpu->registers.E)", 1},
+    /* 0x1D */ {"DEC E", "DEC_r8(cpu, &cpu->registers.E)", 1},
+    /* 0x1E */ {"LD E, n8", "LD_r8_n8(cpu, &cpu->registers.E)", 2},
+    /* 0x1F */ {"RRA", "RRA(cpu, &cpu->registers.A)", 1},
+    /* 0x20 */ {"JR NZ, e8", "JR_CC_n16(cpu, cpu->Z == 0)", 2},
+    /* 0x21 */ {"LD HL, n16", "LD_HL_n16(cpu)", 3},
+    /* 0x22 */ {"LD [HL+], A", "LD_HLI_A(cpu)", 1},
+    /* 0x23 */ {"INC HL", "INC_HL(cpu)", 1},
+    /* 0x24 */ {"INC H", "INC_r8(cpu, &cpu->registers.H)", 1},
+    /* 0x25 */ {"DEC H", "DEC_r8(cpu, &(cpu->registers.H))", 1},
+    /* 0x26 */ {"LD H, n8", "LD_r8_n8(cpu, &cpu->registers.H)", 2},
+    /* 0x27 */ {"DAA", "DAA(cpu)", 1},
+    /* 0x28 */ {"JR Z, e8", "JR_CC_n16(cpu, cpu->Z == 1)", 2},
+    /* 0x29 */ {"ADD HL, HL", "ADD_HL_r16(cpu, get_HL(cpu))", 1},
+    /* 0x2A */ {"LD A, [HL+]", "LD_A_HLI(cpu)", 1},
+    /* 0x2B */ {"DEC HL", "DEC_HL_r16(cpu)", 1},
+    /* 0x2C */ {"INC L", "INC_r8(cpu, &cpu->registers.L)", 1},
+    /* 0x2D */ {"DEC L", "DEC_r8(cpu, &cpu->registers.L)", 1},
+    /* 0x2E */ {"LD L, n8", "LD_r8_n8(cpu, &cpu->registers.L)", 2},
+    /* 0x2F */ {"CPL", "CPL(cpu)", 1},
+    /* 0x30 */ {"JR NC, e8", "JR_CC_n16(cpu, cpu->C == 0)", 2},
+    /* 0x31 */ {"LD SP, n16", "LD_SP_n16(cpu)", 3},
+    /* 0x32 */ {"LD [HL-], A", "LD_HLD_A(cpu)", 1},
+    /* 0x33 */ {"INC SP", "INC_SP(cpu)", 1},
+    /* 0x34 */ {"INC [HL]", "INC_aHL(cpu)", 1},
+    /* 0x35 */ {"DEC [HL]", "DEC_HL_a16(cpu)", 1},
+    /* 0x36 */ {"LD [HL], n8", "LD_HL_n8(cpu)", 2},
+    /* 0x37 */ {"SCF", "SCF(cpu)", 1},
+    /* 0x38 */ {"JR C, e8", "JR_CC_n16(cpu, cpu->C == 1)", 2},
+    /* 0x39 */ {"ADD HL, SP", "ADD_HL_r16(cpu, cpu->SP)", 1},
+    /* 0x3A */ {"LD A, [HL-]", "LD_A_HLD(cpu)", 1},
+    /* 0x3B */ {"DEC SP", "DEC_SP(cpu)", 1},
+    /* 0x3C */ {"INC A", "INC_r8(cpu, &cpu->registers.A)", 1},
+    /* 0x3D */ {"DEC A", "DEC_r8(cpu, &(cpu->registers.A))", 1},
+    /* 0x3E */ {"LD A, n8", "LD_r8_n8(cpu, &cpu->registers.A)", 2},
+    /* 0x3F */ {"CCF", "CCF(cpu)", 1},
+    /* 0x40 */ {"LD B, B", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.B)", 1},
+    /* 0x41 */ {"LD B, C", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.C)", 1},
+    /* 0x42 */ {"LD B, D", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.D)", 1},
+    /* 0x43 */ {"LD B, E", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.E)", 1},
+    /* 0x44 */ {"LD B, H", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.H)", 1},
+    /* 0x45 */ {"LD B, L", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.L)", 1},
+    /* 0x46 */ {"LD B, [HL]", "LD_r8_HL(cpu, &cpu->registers.B)", 1},
+    /* 0x47 */ {"LD B, A", "LD_r8_r8(cpu, &cpu->registers.B, cpu->registers.A)", 1},
+    /* 0x48 */ {"LD C, B", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.B)", 1},
+    /* 0x49 */ {"LD C, C", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.C)", 1},
+    /* 0x4A */ {"LD C, D", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.D)", 1},
+    /* 0x4B */ {"LD C, E", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.E)", 1},
+    /* 0x4C */ {"LD C, H", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.H)", 1},
+    /* 0x4D */ {"LD C, L", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.L)", 1},
+    /* 0x4E */ {"LD C, [HL]", "LD_r8_HL(cpu, &cpu->registers.C)", 1},
+    /* 0x4F */ {"LD C, A", "LD_r8_r8(cpu, &cpu->registers.C, cpu->registers.A)", 1},
+    /* 0x50 */ {"LD D, B", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.B)", 1},
+    /* 0x51 */ {"LD D, C", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.C)", 1},
+    /* 0x52 */ {"LD D, D", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.D)", 1},
+    /* 0x53 */ {"LD D, E", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.E)", 1},
+    /* 0x54 */ {"LD D, H", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.H)", 1},
+    /* 0x55 */ {"LD D, L", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.L)", 1},
+    /* 0x56 */ {"LD D, [HL]", "LD_r8_HL(cpu, &cpu->registers.D)", 1},
+    /* 0x57 */ {"LD D, A", "LD_r8_r8(cpu, &cpu->registers.D, cpu->registers.A)", 1},
+    /* 0x58 */ {"LD E, B", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.B)", 1},
+    /* 0x59 */ {"LD E, C", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.C)", 1},
+    /* 0x5A */ {"LD E, D", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.D)", 1},
+    /* 0x5B */ {"LD E, E", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.E)", 1},
+    /* 0x5C */ {"LD E, H", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.H)", 1},
+    /* 0x5D */ {"LD E, L", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.L)", 1},
+    /* 0x5E */ {"LD E, [HL]", "LD_r8_HL(cpu, &cpu->registers.E)", 1},
+    /* 0x5F */ {"LD E, A", "LD_r8_r8(cpu, &cpu->registers.E, cpu->registers.A)", 1},
+    /* 0x60 */ {"LD H, B", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.B)", 1},
+    /* 0x61 */ {"LD H, C", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.C)", 1},
+    /* 0x62 */ {"LD H, D", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.D)", 1},
+    /* 0x63 */ {"LD H, E", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.E)", 1},
+    /* 0x64 */ {"LD H, H", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.H)", 1},
+    /* 0x65 */ {"LD H, L", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.L)", 1},
+    /* 0x66 */ {"LD H, [HL]", "LD_r8_HL(cpu, &cpu->registers.H)", 1},
+    /* 0x67 */ {"LD H, A", "LD_r8_r8(cpu, &cpu->registers.H, cpu->registers.A)", 1},
+    /* 0x68 */ {"LD L, B", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.B)", 1},
+    /* 0x69 */ {"LD L, C", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.C)", 1},
+    /* 0x6A */ {"LD L, D", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.D)", 1},
+    /* 0x6B */ {"LD L, E", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.E)", 1},
+    /* 0x6C */ {"LD L, H", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.H)", 1},
+    /* 0x6D */ {"LD L, L", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.L)", 1},
+    /* 0x6E */ {"LD L, [HL]", "LD_r8_HL(cpu, &cpu->registers.L)", 1},
+    /* 0x6F */ {"LD L, A", "LD_r8_r8(cpu, &cpu->registers.L, cpu->registers.A)", 1},
+    /* 0x70 */ {"LD [HL], B", "LD_HL_r8(cpu, cpu->registers.B)", 1},
+    /* 0x71 */ {"LD [HL], C", "LD_HL_r8(cpu, cpu->registers.C)", 1},
+    /* 0x72 */ {"LD [HL], D", "LD_HL_r8(cpu, cpu->registers.D)", 1},
+    /* 0x73 */ {"LD [HL], E", "LD_HL_r8(cpu, cpu->registers.E)", 1},
+    /* 0x74 */ {"LD [HL], H", "LD_HL_r8(cpu, cpu->registers.H)", 1},
+    /* 0x75 */ {"LD [HL], L", "LD_HL_r8(cpu, cpu->registers.L)", 1},
+    /* 0x76 */ {"HALT", "HALT(cpu)", 1},
+    /* 0x77 */ {"LD [HL], A", "LD_HL_r8(cpu, cpu->registers.A)", 1},
+    /* 0x78 */ {"LD A, B", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.B)", 1},
+    /* 0x79 */ {"LD A, C", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.C)", 1},
+    /* 0x7A */ {"LD A, D", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.D)", 1},
+    /* 0x7B */ {"LD A, E", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.E)", 1},
+    /* 0x7C */ {"LD A, H", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.H)", 1},
+    /* 0x7D */ {"LD A, L", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.L)", 1},
+    /* 0x7E */ {"LD A, [HL]", "LD_r8_HL(cpu, &cpu->registers.A)", 1},
+    /* 0x7F */ {"LD A, A", "LD_r8_r8(cpu, &cpu->registers.A, cpu->registers.A)", 1},
+    /* 0x80 */ {"ADD A, B", "ADD_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0x81 */ {"ADD A, C", "ADD_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0x82 */ {"ADD A, D", "ADD_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0x83 */ {"ADD A, E", "ADD_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0x84 */ {"ADD A, H", "ADD_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0x85 */ {"ADD A, L", "ADD_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0x86 */ {"ADD A, [HL]", "ADD_A_HL(cpu)", 1},
+    /* 0x87 */ {"ADD A, A", "ADD_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0x88 */ {"ADC A, B", "ADC_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0x89 */ {"ADC A, C", "ADC_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0x8A */ {"ADC A, D", "ADC_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0x8B */ {"ADC A, E", "ADC_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0x8C */ {"ADC A, H", "ADC_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0x8D */ {"ADC A, L", "ADC_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0x8E */ {"ADC A, [HL]", "ADC_A_HL(cpu)", 1},
+    /* 0x8F */ {"ADC A, A", "ADC_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0x90 */ {"SUB A, B", "SUB_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0x91 */ {"SUB A, C", "SUB_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0x92 */ {"SUB A, D", "SUB_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0x93 */ {"SUB A, E", "SUB_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0x94 */ {"SUB A, H", "SUB_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0x95 */ {"SUB A, L", "SUB_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0x96 */ {"SUB A, [HL]", "SUB_A_HL(cpu)", 1},
+    /* 0x97 */ {"SUB A, A", "SUB_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0x98 */ {"SBC A, B", "SBC_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0x99 */ {"SBC A, C", "SBC_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0x9A */ {"SBC A, D", "SBC_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0x9B */ {"SBC A, E", "SBC_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0x9C */ {"SBC A, H", "SBC_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0x9D */ {"SBC A, L", "SBC_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0x9E */ {"SBC A, [HL]", "SBC_A_HL(cpu)", 1},
+    /* 0x9F */ {"SBC A, A", "SBC_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0xA0 */ {"AND A, B", "AND_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0xA1 */ {"AND A, C", "AND_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0xA2 */ {"AND A, D", "AND_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0xA3 */ {"AND A, E", "AND_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0xA4 */ {"AND A, H", "AND_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0xA5 */ {"AND A, L", "AND_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0xA6 */ {"AND A, [HL]", "AND_A_HL(cpu)", 1},
+    /* 0xA7 */ {"AND A, A", "AND_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0xA8 */ {"XOR A, B", "XOR_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0xA9 */ {"XOR A, C", "XOR_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0xAA */ {"XOR A, D", "XOR_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0xAB */ {"XOR A, E", "XOR_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0xAC */ {"XOR A, H", "XOR_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0xAD */ {"XOR A, L", "XOR_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0xAE */ {"XOR A, [HL]", "XOR_A_HL(cpu)", 1},
+    /* 0xAF */ {"XOR A, A", "XOR_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0xB0 */ {"OR A, B", "OR_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0xB1 */ {"OR A, C", "OR_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0xB2 */ {"OR A, D", "OR_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0xB3 */ {"OR A, E", "OR_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0xB4 */ {"OR A, H", "OR_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0xB5 */ {"OR A, L", "OR_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0xB6 */ {"OR A, [HL]", "OR_A_HL(cpu)", 1},
+    /* 0xB7 */ {"OR A, A", "OR_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0xB8 */ {"CP A, B", "CP_A_r8(cpu, cpu->registers.B)", 1},
+    /* 0xB9 */ {"CP A, C", "CP_A_r8(cpu, cpu->registers.C)", 1},
+    /* 0xBA */ {"CP A, D", "CP_A_r8(cpu, cpu->registers.D)", 1},
+    /* 0xBB */ {"CP A, E", "CP_A_r8(cpu, cpu->registers.E)", 1},
+    /* 0xBC */ {"CP A, H", "CP_A_r8(cpu, cpu->registers.H)", 1},
+    /* 0xBD */ {"CP A, L", "CP_A_r8(cpu, cpu->registers.L)", 1},
+    /* 0xBE */ {"CP A, [HL]", "CP_A_HL(cpu)", 1},
+    /* 0xBF */ {"CP A, A", "CP_A_r8(cpu, cpu->registers.A)", 1},
+    /* 0xC0 */ {"RET NZ", "RET_CC(cpu, cpu->Z == 0)", 1},
+    /* 0xC1 */ {"POP BC", "POP_BC(cpu)", 1},
+    /* 0xC2 */ {"JP NZ, a16", "JP_CC_n16(cpu, cpu->Z == 0)", 3},
+    /* 0xC3 */ {"JP a16", "JP_n16(cpu)", 3},
+    /* 0xC4 */ {"CALL NZ, a16", "CALL_CC_n16(cpu, cpu->Z == 0)", 3},
+    /* 0xC5 */ {"PUSH BC", "PUSH_BC(cpu)", 1},
+    /* 0xC6 */ {"ADD A, n8", "ADD_A_n8(cpu)", 2},
+    /* 0xC7 */ {"RST $00", "RST_vec(cpu, 0x0)", 1},
+    /* 0xC8 */ {"RET Z", "RET_CC(cpu, cpu->Z == 1)", 1},
+    /* 0xC9 */ {"RET", "RET(cpu)", 1},
+    /* 0xCA */ {"JP Z, a16", "JP_CC_n16(cpu, cpu->Z == 1)", 3},
+    /* 0xCB */ {"PREFIX CB", "exec_CB(cpu)", 2},
+    /* 0xCC */ {"CALL Z, a16", "CALL_CC_n16(cpu, cpu->Z == 1)", 3},
+    /* 0xCD */ {"CALL a16", "CALL_n16(cpu)", 3},
+    /* 0xCE */ {"ADC A, n8", "ADC_A_n8(cpu)", 2},
+    /* 0xCF */ {"RST $08", "RST_vec(cpu, 0x08)", 1},
+    /* 0xD0 */ {"RET NC", "RET_CC(cpu, cpu->C == 0)", 1},
+    /* 0xD1 */ {"POP DE", "POP_DE(cpu)", 1},
+    /* 0xD2 */ {"JP NC, a16", "JP_CC_n16(cpu, cpu->C == 0)", 3},
+    /* 0xD3 */ {NULL, NULL, 1},
+    /* 0xD4 */ {"CALL NC, a16", "CALL_CC_n16(cpu, cpu->C == 0)", 3},
+    /* 0xD5 */ {"PUSH DE", "PUSH_DE(cpu)", 1},
+    /* 0xD6 */ {"SUB A, n8", "SUB_A_n8(cpu)", 2},
+    /* 0xD7 */ {"RST $10", "RST_vec(cpu, 0x10)", 1},
+    /* 0xD8 */ {"RET C", "RET_CC(cpu, cpu->C == 1)", 1},
+    /* 0xD9 */ {"RETI", "RETI(cpu)", 1},
+    /* 0xDA */ {"JP C, a16", "JP_CC_n16(cpu, cpu->C == 1)", 3},
+    /* 0xDB */ {NULL, NULL, 1},
+    /* 0xDC */ {"CALL C, a16", "CALL_CC_n16(cpu, cpu->C == 1)", 3},
+    /* 0xDD */ {NULL, NULL, 1},
+    /* 0xDE */ {"SBC A, n8", "SBC_A_n8(cpu)", 2},
+    /* 0xDF */ {"RST $18", "RST_vec(cpu, 0x18)", 1},
+    /* 0xE0 */ {"LDH [a8], A", "LD_a8_A(cpu)", 2},
+    /* 0xE1 */ {"POP HL", "POP_HL(cpu)", 1},
+    /* 0xE2 */ {"LDH [C], A", "LD_C_A(cpu)", 1},
+    /* 0xE3 */ {NULL, NULL, 1},
+    /* 0xE4 */ {NULL, NULL, 1},
+    /* 0xE5 */ {"PUSH HL", "PUSH_HL(cpu)", 1},
+    /* 0xE6 */ {"AND A, n8", "AND_A_n8(cpu)", 2},
+    /* 0xE7 */ {"RST $20", "RST_vec(cpu, 0x20)", 1},
+    /* 0xE8 */ {"ADD SP, e8", "ADD_SP_s8(cpu)", 2},
+    /* 0xE9 */ {"JP HL", "JP_HL(cpu)", 1},
+    /* 0xEA */ {"LD [a16], A", "LD_a16_A(cpu)", 3},
+    /* 0xEB */ {NULL, NULL, 1},
+    /* 0xEC */ {NULL, NULL, 1},
+    /* 0xED */ {NULL, NULL, 1},
+    /* 0xEE */ {"XOR A, n8", "XOR_A_n8(cpu)", 2},
+    /* 0xEF */ {"RST $28", "RST_vec(cpu, 0x28)", 1},
+    /* 0xF0 */ {"LDH A, [a8]", "LD_A_a8(cpu)", 2},
+    /* 0xF1 */ {"POP AF", "POP_AF(cpu)", 1},
+    /* 0xF2 */ {"LDH A, [C]", "LD_A_C(cpu)", 1},
+    /* 0xF3 */ {"DI", "DI(cpu)", 1},
+    /* 0xF4 */ {NULL, NULL, 1},
+    /* 0xF5 */ {"PUSH AF", "PUSH_AF(cpu)", 1},
+    /* 0xF6 */ {"OR A, n8", "OR_A_n8(cpu)", 2},
+    /* 0xF7 */ {"RST $30", "RST_vec(cpu, 0x30)", 1},
+    /* 0xF8 */ {"LD HL, SP + e8", "LD_HL_SP_s8(cpu)", 2},
+    /* 0xF9 */ {"LD SP, HL", "LD_SP_HL(cpu)", 1},
+    /* 0xFA */ {"LD A, [a16]", "LD_A_a16(cpu)", 3},
+    /* 0xFB */ {"EI", "EI(cpu)", 1},
+    /* 0xFC */ {NULL, NULL, 1},
+    /* 0xFD */ {NULL, NULL, 1},
+    /* 0xFE */ {"CP A, n8", "CP_A_n8(cpu)", 2},
+    /* 0xFF */ {"RST $38", "RST_vec(cpu, 0x38)", 1},
+};
+
+typedef struct Rom
+{
+    __uint8_t *data;
+    size_t size;
+    int banks;
+    bool mbc1;
+    // One slot per 16K window: slot 0 is 0x0000-0x3FFF, slot 1 + b is
+    // 0x4000-0x7FFF with bank b mapped
+    __uint8_t *flags;
+} Rom;
+
+typedef struct Target
+{
+    int slot;
+    __uint16_t address;
+} Target;
+
+static Target *stack;
+static int stack_size;
+
+static __uint8_t rom_byte(Rom *rom, int slot, __uint16_t address)
+{
+    size_t offset = slot == 0 ? address : (size_t)(slot - 1) * SLOT_SIZE + (address - 0x4000);
+    return offset < rom->size ? rom->data[offset] : 0xFF;
+}
+
+static __uint8_t *slot_flags(Rom *rom, int slot, __uint16_t address)
+{
+    return &rom->flags[slot * SLOT_SIZE + (address & 0x3FFF)];
+}
+
+static void push(int slot, __uint16_t address)
+{
+    if (stack_size == MAX_STACK)
+    {
+        printf("Disassembly stack overflow\n");
+        exit(1);
+    }
+    stack[stack_size].slot = slot;
+    stack[stack_size].address = address;
+    stack_size++;
+}
+
+// Queue a jump target seen from code in from_slot. Region 1 targets reached
+// from region 0 can run with any bank mapped, so queue them for all banks.
+static void add_target(Rom *rom, int from_slot, __uint16_t address)
+{
+    if (address < 0x4000)
+        push(0, address);
+    else if (address < 0x8000 && from_slot > 0)
+        push(from_slot, address);
+    else if (address < 0x8000 && !rom->mbc1)
+        push(2, address);
+    else if (address < 0x8000)
+    {
+        for (int bank = 1; bank < rom->banks; bank++)
+            push(1 + bank, address);
+    }
+}
+
+static bool ends_block(__uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x10: // STOP
+    case 0x18: // JR e8
+    case 0x20: // JR cc, e8
+    case 0x28:
+    case 0x30:
+    case 0x38:
+    case 0x76: // HALT
+    case 0xC0: // RET cc
+    case 0xC8:
+    case 0xD0:
+    case 0xD8:
+    case 0xC2: // JP cc, a16
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+    case 0xC4: // CALL cc, a16
+    case 0xCC:
+    case 0xD4:
+    case 0xDC:
+    case 0xC3: // JP a16
+    case 0xC9: // RET
+    case 0xCD: // CALL a16
+    case 0xD9: // RETI
+    case 0xE9: // JP HL
+        return true;
+    default:
+        return (opcode & 0xC7) == 0xC7; // RST
+    }
+}
+
+static bool falls_through(__uint8_t opcode)
+{
+    return opcode != 0x18 && opcode != 0xC3 && opcode != 0xC9 && opcode != 0xD9 && opcode != 0xE9;
+}
+
+static void disassemble(Rom *rom)
+{
+    while (stack_size > 0)
+    {
+        Target target = stack[--stack_size];
+        int slot = target.slot;
+        __uint16_t address = target.address;
+
+        while (true)
+        {
+            __uint8_t *flags = slot_flags(rom, slot, address);
+            __uint8_t opcode = rom_byte(rom, slot, address);
+            const Opcode *op = &opcodes[opcode];
+
+            if ((*flags & VISITED) || op->call == NULL)
+                break;
+            if (((address + op->length - 1) & 0xC000) != (address & 0xC000))
+                break; // runs off the end of the window
+            *flags |= VISITED;
+
+            __uint16_t next = address + op->length;
+            __uint8_t n8 = rom_byte(rom, slot, address + 1);
+            __uint16_t n16 = n8 | (rom_byte(rom, slot, address + 2) << 8);
+
+            if (opcode == 0x18 || (opcode & 0xE7) == 0x20)
+                add_target(rom, slot, next + (__int8_t)n8);
+            else if (opcode == 0xC3 || opcode == 0xCD || (opcode & 0xE7) == 0xC2 || (opcode & 0xE7) == 0xC4)
+                add_target(rom, slot, n16);
+            else if ((opcode & 0xC7) == 0xC7)
+                add_target(rom, slot, opcode & 0x38);
+
+            if (!falls_through(opcode))
+                break;
+            if (ends_block(opcode))
+            {
+                if ((next & 0xC000) == (address & 0xC000))
+                    push(slot, next);
+                break;
+            }
+            if ((next & 0xC000) != (address & 0xC000))
+                break;
+            address = next;
+        }
+    }
+}
+
+static void slot_name(int slot, char *name)
+{
+    if (slot == 0)
+        strcpy(name, "run_rom0");
+    else
+        sprintf(name, "run_bank%d", slot - 1);
+}
+
+static int emit_slot(Rom *rom, int slot, FILE *out)
+{
+    __uint16_t base = slot == 0 ? 0x0000 : 0x4000;
+    int count = 0;
+    char name[32];
+
+    for (int i = 0; i < SLOT_SIZE; i++)
+        count += (rom->flags[slot * SLOT_SIZE + i] & VISITED) != 0;
+    if (count == 0)
+        return 0;
+
+    slot_name(slot, name);
+    fprintf(out, "static __uint32_t %s(CPU *cpu)\n{\n", name);
+    fprintf(out, "    __uint32_t t_cycles = 0;\n\n    switch (cpu->PC)\n    {\n");
+    for (int i = 0; i < SLOT_SIZE; i++)
+    {
+        if (rom->flags[slot * SLOT_SIZE + i] & VISITED)
+            fprintf(out, "    case 0x%04X:\n        goto l_%04X;\n", base + i, base + i);
+    }
+    fprintf(out, "    default:\n        return 0;\n    }\n");
+
+    for (int i = 0; i < SLOT_SIZE; i++)
+    {
+        if (!(rom->flags[slot * SLOT_SIZE + i] & VISITED))
+            continue;
+
+        __uint16_t address = base + i;
+        __uint8_t opcode = rom_byte(rom, slot, address);
+        const Opcode *op = &opcodes[opcode];
+        __uint16_t next = address + op->length;
+
+        fprintf(out, "\nl_%04X: // %s", address, op->mnemonic);
+        for (int b = 1; b < op->length; b++)
+            fprintf(out, " %02X", rom_byte(rom, slot, address + b));
+        fprintf(out, "\n    cpu->PC = 0x%04X;\n", (__uint16_t)(address + 1));
+        fprintf(out, "    update_timer(cpu, 4);\n");
+        fprintf(out, "    t_cycles += %s;\n", op->call);
+        fprintf(out, "    update_IME(cpu, 0x%02X);\n", opcode);
+        fprintf(out, "    if (handle_interrupts(cpu))\n        return t_cycles;\n");
+        fprintf(out, "    TRACE_INSTRUCTION(cpu);\n");
+        if (slot > 0 && rom->mbc1)
+            fprintf(out, "    if (BANK != %d)\n        return t_cycles;\n", slot - 1);
+
+        bool next_visited = (next & 0xC000) == (address & 0xC000) &&
+                            (*slot_flags(rom, slot, next) & VISITED);
+        if (ends_block(opcode) || !next_visited)
+        {
+            fprintf(out, "    return t_cycles;\n");
+            continue;
+        }
+        // What CPU_start does between two instructions
+        fprintf(out, "    if (recomp_yield(cpu))\n        return t_cycles;\n");
+        fprintf(out, "    update_joypad(cpu);\n    if (cpu->sampler)\n        sampler_tick(cpu);\n");
+        // Another entry point decodes from inside this instruction, so the
+        // next label isn't the fallthrough
+        for (int j = i + 1; j < i + op->length; j++)
+        {
+            if (rom->flags[slot * SLOT_SIZE + j] & VISITED)
+            {
+                fprintf(out, "    goto l_%04X;\n", next);
+                break;
+            }
+        }
+    }
+    fprintf(out, "}\n\n");
+    return count;
+}
+
+static void emit(Rom *rom, FILE *out, const char *rom_path)
+{
+    int slots = 2 + rom->banks;
+    int total = 0;
+    char name[32];
+
+    fprintf(out, "// Generated by tools/recomp.c from %s. Do not edit.\n", rom_path);
+    fprintf(out, "#include \"cpu.h\"\n#include \"memory.h\"\n#include \"timer.h\"\n");
+    fprintf(out, "#include \"joypad.h\"\n#include \"opcodes.h\"\n#include \"recomp.h\"\n#include \"sampler.h\"\n");
+    fprintf(out, "#include \"trace.h\"\n\n");
+    fprintf(out, "#define BANK (cpu->cartridge->type == MBC1 ? cpu->cartridge->rom_bank %% %d : 1)\n\n", rom->banks);
+
+    bool *emitted = calloc(slots, sizeof(bool));
+    for (int slot = 0; slot < slots; slot++)
+    {
+        int count = emit_slot(rom, slot, out);
+        emitted[slot] = count > 0;
+        total += count;
+        if (count)
+        {
+            slot_name(slot, name);
+            fprintf(stderr, "%s: %d instructions\n", name, count);
+        }
+    }
+
+    fprintf(out, "__uint32_t recomp_run(CPU *cpu)\n{\n");
+    fprintf(out, "    if (cpu->PC >= 0x8000)\n        return 0;\n");
+    if (emitted[0])
+        fprintf(out, "    if (cpu->PC < 0x4000)\n        return run_rom0(cpu);\n");
+    else
+        fprintf(out, "    if (cpu->PC < 0x4000)\n        return 0;\n");
+    fprintf(out, "\n    switch (BANK)\n    {\n");
+    for (int slot = 1; slot < slots; slot++)
+    {
+        if (!emitted[slot])
+            continue;
+        slot_name(slot, name);
+        fprintf(out, "    case %d:\n        return %s(cpu);\n", slot - 1, name);
+    }
+    fprintf(out, "    default:\n        return 0;\n    }\n}\n");
+    fprintf(stderr, "%d instructions translated\n", total);
+    free(emitted);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s rom.gb out.c\n", argv[0]);
+        exit(1);
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        perror("Failed to open ROM");
+        exit(1);
+    }
+    Rom rom = {0};
+    fseek(f, 0, SEEK_END);
+    rom.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    rom.data = malloc(rom.size);
+    if (fread(rom.data, 1, rom.size, f) != rom.size)
+    {
+        perror("Failed to read ROM");
+        exit(1);
+    }
+    fclose(f);
+
+    if (rom.size < 0x8000)
+    {
+        printf("ROM too small: %zu bytes\n", rom.size);
+        exit(1);
+    }
+    __uint8_t type = rom.data[0x147];
+    if (type > 0x03)
+    {
+        printf("Unsupported cartridge type: 0x%02X\n", type);
+        exit(1);
+    }
+    rom.mbc1 = type != 0x00;
+    rom.banks = rom.size / SLOT_SIZE;
+    rom.flags = calloc((size_t)(2 + rom.banks) * SLOT_SIZE, 1);
+    stack = malloc(MAX_STACK * sizeof(Target));
+
+    push(0, 0x0100);
+    for (__uint16_t vector = 0x00; vector <= 0x60; vector += 8)
+        push(0, vector);
+    disassemble(&rom);
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out)
+    {
+        perror("Failed to open output");
+        exit(1);
+    }
+    emit(&rom, out, argv[1]);
+    fclose(out);
+    return 0;
+}
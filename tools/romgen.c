@@ -0,0 +1,434 @@
+// Builds the synthetic benchmark ROMs: romgen [-l] DIR [NAME...]
+//
+// Each workload is a small DMG program assembled here, so the benchmarks
+// need no commercial ROMs and always run the same code. They set up tiles
+// and a tilemap with the LCD off and then loop forever on one hot path:
+//   alu      register ALU loop
+//   hl       (HL) loads, stores and read-modify-writes over WRAM
+//   mbc1     MBC1 ROM and RAM bank switching storm with banked reads and writes
+//   sprites  40 8x16 sprites in 4 bands of 10 per line, moved and DMAed each frame
+//   window   LYC interrupt splits moving the window and scroll 4 times a frame
+//   lypoll   busy-waits on LY for every line to set a per-line scroll
+// Writes DIR/NAME.gb for every workload, or only the ones named; -l lists them.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// I/O registers, as offsets for LDH
+#define R_LCDC 0x40
+#define R_STAT 0x41
+#define R_SCY 0x42
+#define R_SCX 0x43
+#define R_LY 0x44
+#define R_LYC 0x45
+#define R_DMA 0x46
+#define R_BGP 0x47
+#define R_OBP0 0x48
+#define R_OBP1 0x49
+#define R_WY 0x4A
+#define R_WX 0x4B
+#define R_IF 0x0F
+#define R_IE 0xFF
+
+// Jumps taking a relative or absolute target
+#define JR 0x18
+#define JR_NZ 0x20
+#define JR_NC 0x30
+#define JR_C 0x38
+#define JP 0xC3
+
+#define MAIN 0x0150
+
+typedef struct Rom
+{
+    __uint8_t *data;
+    size_t size;
+    __uint32_t pc; // where the next byte is assembled
+} Rom;
+
+typedef struct Workload
+{
+    const char *name;
+    __uint8_t type; // cartridge header 0x147
+    __uint8_t rom_code;
+    __uint8_t ram_code;
+    void (*build)(Rom *rom);
+} Workload;
+
+static const __uint8_t logo[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E};
+
+static void emit_bytes(Rom *rom, const __uint8_t *bytes, size_t count)
+{
+    if (rom->pc + count > rom->size)
+    {
+        printf("Assembled past the end of the ROM at 0x%X\n", rom->pc);
+        exit(1);
+    }
+    memcpy(rom->data + rom->pc, bytes, count);
+    rom->pc += count;
+}
+
+#define EMIT(rom, ...) emit_bytes(rom, (const __uint8_t[]){__VA_ARGS__}, sizeof((const __uint8_t[]){__VA_ARGS__}))
+
+static void org(Rom *rom, __uint32_t address)
+{
+    rom->pc = address;
+}
+
+// Backward jumps to a known address
+static void jr(Rom *rom, __uint8_t opcode, __uint32_t target)
+{
+    int offset = (int)target - (int)(rom->pc + 2);
+    if (offset < -128 || offset > 127)
+    {
+        printf("JR from 0x%X to 0x%X out of range\n", rom->pc, target);
+        exit(1);
+    }
+    EMIT(rom, opcode, (__uint8_t)offset);
+}
+
+static void jp(Rom *rom, __uint8_t opcode, __uint16_t target)
+{
+    EMIT(rom, opcode, target & 0xFF, target >> 8);
+}
+
+// Forward jumps: emit with a placeholder, resolve to the current address
+static __uint32_t jr_forward(Rom *rom, __uint8_t opcode)
+{
+    EMIT(rom, opcode, 0);
+    return rom->pc - 1;
+}
+
+static void resolve(Rom *rom, __uint32_t site)
+{
+    rom->data[site] = rom->pc - (site + 1);
+}
+
+static void set_io(Rom *rom, __uint8_t reg, __uint8_t value)
+{
+    EMIT(rom, 0x3E, value, 0xE0, reg); // ld a,value / ldh (reg),a
+}
+
+// Copies count (1-256) bytes from src to dst
+static void copy(Rom *rom, __uint16_t dst, __uint16_t src, int count)
+{
+    EMIT(rom, 0x21, src & 0xFF, src >> 8,  // ld hl,src
+         0x11, dst & 0xFF, dst >> 8,       // ld de,dst
+         0x06, count & 0xFF);              // ld b,count
+    __uint32_t loop = rom->pc;
+    EMIT(rom, 0x2A, 0x12, 0x13, 0x05);     // ld a,(hl+) / ld (de),a / inc de / dec b
+    jr(rom, JR_NZ, loop);
+}
+
+// Common start: stack, LCD off at vblank, patterned tiles in all of tile
+// data, tile numbers in both tilemaps, palettes, OAM cleared. Leaves
+// interrupts disabled and the LCD off.
+static void setup(Rom *rom)
+{
+    EMIT(rom, 0xF3,               // di
+         0x31, 0xFE, 0xDF,        // ld sp,$DFFE
+         0xF0, R_LCDC, 0x87);     // ldh a,(LCDC) / add a
+    __uint32_t off = jr_forward(rom, JR_NC);
+    __uint32_t wait = rom->pc;
+    EMIT(rom, 0xF0, R_LY, 0xFE, 144); // ldh a,(LY) / cp 144
+    jr(rom, JR_C, wait);
+    resolve(rom, off);
+    EMIT(rom, 0xAF, 0xE0, R_LCDC); // xor a / ldh (LCDC),a
+
+    EMIT(rom, 0x21, 0x00, 0x80); // ld hl,$8000
+    __uint32_t tiles = rom->pc;
+    EMIT(rom, 0x7D, 0xAC, 0x22,  // ld a,l / xor h / ld (hl+),a
+         0x7C, 0xFE, 0x98);      // ld a,h / cp $98
+    jr(rom, JR_NZ, tiles);
+    __uint32_t map = rom->pc;
+    EMIT(rom, 0x7D, 0x84, 0x22,  // ld a,l / add h / ld (hl+),a
+         0x7C, 0xFE, 0xA0);      // ld a,h / cp $A0
+    jr(rom, JR_NZ, map);
+
+    EMIT(rom, 0x21, 0x00, 0xFE, // ld hl,$FE00
+         0xAF, 0x06, 160);      // xor a / ld b,160
+    __uint32_t oam = rom->pc;
+    EMIT(rom, 0x22, 0x05);      // ld (hl+),a / dec b
+    jr(rom, JR_NZ, oam);
+
+    set_io(rom, R_BGP, 0xE4);
+    set_io(rom, R_OBP0, 0xE4);
+    set_io(rom, R_OBP1, 0x1B);
+    set_io(rom, R_SCX, 0);
+    set_io(rom, R_SCY, 0);
+    set_io(rom, R_IF, 0);
+}
+
+// For the workloads with a still picture: the vblank handler scrolls by
+// the register the loop computes into, loaded by ld_a (ld a,r), so the
+// frame hash depends on the results
+static void show(Rom *rom, __uint8_t ld_a)
+{
+    __uint32_t pc = rom->pc;
+    org(rom, 0x40);
+    EMIT(rom, 0xF5, ld_a, 0xE0, R_SCX, // push af / ld a,r / ldh (SCX),a
+         0xF1, 0xD9);                  // pop af / reti
+    org(rom, pc);
+}
+
+static void alu(Rom *rom)
+{
+    show(rom, 0x7F); // a
+    setup(rom);
+    set_io(rom, R_IE, 0x01);
+    set_io(rom, R_LCDC, 0x91);
+    EMIT(rom, 0xFB,           // ei
+         0x0E, 0x05,          // ld c,5
+         0x16, 0x77);         // ld d,$77
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x06, 0x40);    // ld b,64
+    __uint32_t loop = rom->pc;
+    EMIT(rom, 0x81, 0xCE, 0x37, // add c / adc $37
+         0x92, 0x9B, 0xA1,      // sub d / sbc e / and c
+         0xB2, 0xAC, 0xBD,      // or d / xor h / cp l
+         0x2F, 0x37, 0x3F,      // cpl / scf / ccf
+         0x0C, 0x1D, 0x13, 0x2B, // inc c / dec e / inc de / dec hl
+         0x57, 0x3C, 0x07, 0x1F, // ld d,a / inc a / rlca / rra
+         0xD6, 0x11, 0xEE, 0x5A, // sub $11 / xor $5A
+         0x05);                 // dec b
+    jr(rom, JR_NZ, loop);
+    jr(rom, JR, main);
+}
+
+static void hl(Rom *rom)
+{
+    show(rom, 0x7F); // a
+    setup(rom);
+    set_io(rom, R_IE, 0x01);
+    set_io(rom, R_LCDC, 0x91);
+    EMIT(rom, 0xFB); // ei
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x21, 0x00, 0xC0,  // ld hl,$C000
+         0x11, 0x00, 0xD0);      // ld de,$D000
+    __uint32_t loop = rom->pc;
+    EMIT(rom, 0x2A, 0x86, 0x77,  // ld a,(hl+) / add (hl) / ld (hl),a
+         0x34, 0xAE, 0x12, 0x13, // inc (hl) / xor (hl) / ld (de),a / inc de
+         0x35, 0x7E, 0x1A,       // dec (hl) / ld a,(hl) / ld a,(de)
+         0x7C, 0xFE, 0xC8);      // ld a,h / cp $C8
+    jr(rom, JR_NZ, loop);
+    jr(rom, JR, main);
+}
+
+static void mbc1(Rom *rom)
+{
+    // every switchable bank starts with its own number
+    for (__uint32_t bank = 1; bank < rom->size / 0x4000; bank++)
+        for (__uint32_t i = 0; i < 0x4000; i++)
+            rom->data[bank * 0x4000 + i] = i ? (bank * 31 + i) & 0xFF : bank;
+
+    show(rom, 0x79); // c
+    setup(rom);
+    set_io(rom, R_IE, 0x01);
+    set_io(rom, R_LCDC, 0x91);
+    EMIT(rom, 0x3E, 0x0A, 0xEA, 0x00, 0x00, // ld a,$0A / ld ($0000),a: RAM on
+         0x3E, 0x01, 0xEA, 0x00, 0x60,      // ld a,1 / ld ($6000),a: RAM banking
+         0xFB);                             // ei
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x06, 0x01); // ld b,1
+    __uint32_t loop = rom->pc;
+    EMIT(rom, 0x78, 0xEA, 0x00, 0x20,       // ld a,b / ld ($2000),a: ROM bank
+         0x21, 0x00, 0x40,                  // ld hl,$4000
+         0x2A, 0x86, 0x4F,                  // ld a,(hl+) / add (hl) / ld c,a
+         0xFA, 0xFF, 0x7F, 0xA9, 0x4F,      // ld a,($7FFF) / xor c / ld c,a
+         0x78, 0xE6, 0x03, 0xEA, 0x00, 0x40, // ld a,b / and 3 / ld ($4000),a: RAM bank
+         0x21, 0x00, 0xA0,                  // ld hl,$A000
+         0x79, 0x22, 0x86, 0x77,            // ld a,c / ld (hl+),a / add (hl) / ld (hl),a
+         0x04, 0x78, 0xFE, 0x20);           // inc b / ld a,b / cp 32
+    jr(rom, JR_NZ, loop);
+    jr(rom, JR, main);
+}
+
+// 40 8x16 sprites in 4 bands of 16 lines, 10 on every line of a band
+static void sprites(Rom *rom)
+{
+    __uint8_t dma[] = {0x3E, 0xC1, 0xE0, R_DMA, // ld a,$C1 / ldh (DMA),a
+                       0x3E, 40,                // ld a,40
+                       0x3D, 0x20, 0xFD,        // dec a / jr nz,-3
+                       0xC9};                   // ret
+    __uint8_t oam[160];
+    for (int i = 0; i < 40; i++)
+    {
+        oam[i * 4] = 16 + (i / 10) * 36;
+        oam[i * 4 + 1] = 8 + (i % 10) * 16 + i / 10;
+        oam[i * 4 + 2] = i * 2;
+        oam[i * 4 + 3] = (i & 1) << 4 | (i & 2) << 6; // palette, priority
+    }
+    __uint16_t dma_src = 0x0800;
+    __uint16_t oam_src = 0x0900;
+    memcpy(rom->data + dma_src, dma, sizeof(dma));
+    memcpy(rom->data + oam_src, oam, sizeof(oam));
+
+    org(rom, 0x40);
+    EMIT(rom, 0xF5, 0xCD, 0x80, 0xFF, 0xF1, 0xD9); // push af / call $FF80 / pop af / reti
+
+    org(rom, MAIN);
+    setup(rom);
+    copy(rom, 0xFF80, dma_src, sizeof(dma));
+    copy(rom, 0xC100, oam_src, sizeof(oam));
+    set_io(rom, R_IE, 0x01);
+    set_io(rom, R_LCDC, 0x97);
+    EMIT(rom, 0xFB); // ei
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x76,              // halt
+         0x21, 0x01, 0xC1,       // ld hl,$C101: first X
+         0x06, 40);              // ld b,40
+    __uint32_t loop = rom->pc;
+    EMIT(rom, 0x34,              // inc (hl)
+         0x7D, 0xC6, 0x04, 0x6F, // ld a,l / add 4 / ld l,a
+         0x05);                  // dec b
+    jr(rom, JR_NZ, loop);
+    jr(rom, JR, main);
+}
+
+// The LYC handler moves the window between the left and the right half
+// and steps the scroll every 36 lines
+static void window(Rom *rom)
+{
+    org(rom, 0x48);
+    jp(rom, JP, 0x1000);
+    org(rom, 0x1000);
+    EMIT(rom, 0xF5,                   // push af
+         0xF0, R_LYC, 0xC6, 36,       // ldh a,(LYC) / add 36
+         0xFE, 144);                  // cp 144
+    __uint32_t ok = jr_forward(rom, JR_C);
+    EMIT(rom, 0xAF);                  // xor a
+    resolve(rom, ok);
+    EMIT(rom, 0xE0, R_LYC,            // ldh (LYC),a
+         0xF0, R_WX, 0xEE, 0x50, 0xE0, R_WX,      // ldh a,(WX) / xor 7^87 / ldh (WX),a
+         0xF0, R_SCX, 0xC6, 0x08, 0xE0, R_SCX,    // ldh a,(SCX) / add 8 / ldh (SCX),a
+         0xF1, 0xD9);                 // pop af / reti
+
+    org(rom, MAIN);
+    setup(rom);
+    set_io(rom, R_WY, 0);
+    set_io(rom, R_WX, 7);
+    set_io(rom, R_LYC, 0);
+    set_io(rom, R_STAT, 0x40);
+    set_io(rom, R_IE, 0x03);
+    set_io(rom, R_LCDC, 0xF1); // window on, window map at $9C00
+    EMIT(rom, 0xFB);           // ei
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x76);           // halt
+    jr(rom, JR, main);
+}
+
+static void lypoll(Rom *rom)
+{
+    setup(rom);
+    set_io(rom, R_LCDC, 0x91);
+    EMIT(rom, 0x0E, 0x00);   // ld c,0
+    __uint32_t main = rom->pc;
+    EMIT(rom, 0x06, 0x00);   // ld b,0
+    __uint32_t line = rom->pc;
+    EMIT(rom, 0xF0, R_LY, 0xB8); // ldh a,(LY) / cp b
+    jr(rom, JR_NZ, line);
+    EMIT(rom, 0x78, 0x81, 0xE0, R_SCX, // ld a,b / add c / ldh (SCX),a
+         0x04, 0x78, 0xFE, 144);       // inc b / ld a,b / cp 144
+    jr(rom, JR_NZ, line);
+    EMIT(rom, 0x0C);         // inc c
+    jr(rom, JR, main);
+}
+
+static const Workload workloads[] = {
+    {"alu", 0x00, 0x00, 0x00, alu},
+    {"hl", 0x00, 0x00, 0x00, hl},
+    {"mbc1", 0x03, 0x04, 0x03, mbc1}, // MBC1+RAM+BATTERY, 512 KB ROM, 32 KB RAM
+    {"sprites", 0x00, 0x00, 0x00, sprites},
+    {"window", 0x00, 0x00, 0x00, window},
+    {"lypoll", 0x00, 0x00, 0x00, lypoll},
+};
+
+static void build(const Workload *w, const char *dir)
+{
+    Rom rom = {0};
+    rom.size = 0x8000 << w->rom_code;
+    rom.data = calloc(1, rom.size);
+
+    // interrupt vectors return, the workload can replace them
+    for (__uint32_t vector = 0x40; vector <= 0x60; vector += 8)
+        rom.data[vector] = 0xD9; // reti
+    org(&rom, 0x100);
+    EMIT(&rom, 0x00); // nop
+    jp(&rom, JP, MAIN);
+    org(&rom, MAIN);
+    w->build(&rom);
+
+    memcpy(rom.data + 0x104, logo, sizeof(logo));
+    snprintf((char *)rom.data + 0x134, 16, "BENCH %s", w->name);
+    for (char *c = (char *)rom.data + 0x134; *c; c++)
+        if (*c >= 'a' && *c <= 'z')
+            *c -= 'a' - 'A';
+    rom.data[0x147] = w->type;
+    rom.data[0x148] = w->rom_code;
+    rom.data[0x149] = w->ram_code;
+    rom.data[0x14A] = 0x01; // non-Japanese
+    __uint8_t header = 0;
+    for (int i = 0x134; i <= 0x14C; i++)
+        header = header - rom.data[i] - 1;
+    rom.data[0x14D] = header;
+    __uint16_t global = 0;
+    for (size_t i = 0; i < rom.size; i++)
+        if (i != 0x14E && i != 0x14F)
+            global += rom.data[i];
+    rom.data[0x14E] = global >> 8;
+    rom.data[0x14F] = global & 0xFF;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.gb", dir, w->name);
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fwrite(rom.data, 1, rom.size, out);
+    fclose(out);
+    free(rom.data);
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = sizeof(workloads) / sizeof(workloads[0]);
+
+    if (argc == 2 && strcmp(argv[1], "-l") == 0)
+    {
+        for (size_t i = 0; i < count; i++)
+            printf("%s\n", workloads[i].name);
+        return 0;
+    }
+    if (argc < 2)
+    {
+        printf("Usage: %s [-l] DIR [NAME...]\n", argv[0]);
+        return 2;
+    }
+    const char *dir = argv[1];
+    for (int arg = 2; arg < argc; arg++)
+    {
+        bool known = false;
+        for (size_t i = 0; i < count; i++)
+            known |= strcmp(argv[arg], workloads[i].name) == 0;
+        if (!known)
+        {
+            printf("Unknown workload: %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        bool selected = argc == 2;
+        for (int arg = 2; arg < argc; arg++)
+            selected |= strcmp(argv[arg], workloads[i].name) == 0;
+        if (selected)
+            build(&workloads[i], dir);
+    }
+    return 0;
+}
@@ -0,0 +1,364 @@
+// Runs conformance test ROMs headless, in parallel, and reports pass/fail:
+//   testroms [-j JOBS] [--timeout CYCLES] [--list FILE] [ROM|DIR...]
+//
+// Every ROM runs in its own forked process (a ROM that makes the emulator
+// exit or crash fails alone) until one of these decides it, checked every
+// SLICE_CYCLES emulated T-cycles:
+//   serial     Blargg's tests print through the link port; "Passed" passes,
+//              "Failed" fails
+//   signature  Blargg's tests without serial output write DE B0 61 to
+//              A001-A003 and the result to A000 (0x80 while running, 0 passed)
+//   mooneye    Mooneye's tests end with B, C, D, E, H, L = 3, 5, 8, 13, 21, 34
+//              when they pass and all 0x42 when they fail
+//   hash       the frame hash (as --bench prints it) given for the ROM shows
+//              up at a frame boundary
+// A ROM that decides nothing within its timeout (default DEFAULT_TIMEOUT,
+// about 2 minutes of emulated time) times out. DIRs are searched for .gb
+// files. FILE lists one ROM per line, optionally with "timeout=CYCLES" and
+// "hash=HEX", and '#' comments. Exits 1 unless every ROM passed.
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "memory.h"
+#include "serial.h"
+#include "state.h"
+#define DEFAULT_TIMEOUT (120ULL * 4194304)
+#define SLICE_CYCLES 70224 // a frame's worth
+#define MAX_JOBS 256
+
+typedef enum
+{
+    RESULT_PASS,
+    RESULT_FAIL,
+    RESULT_TIMEOUT,
+    RESULT_CRASH,
+} Status;
+
+static const char *status_names[] = {"PASS", "FAIL", "TIMEOUT", "CRASH"};
+
+typedef struct Test
+{
+    char *path;
+    __uint64_t timeout;
+    __uint64_t hash;
+    bool has_hash;
+} Test;
+
+// What a worker sends back through its pipe
+typedef struct Result
+{
+    Status status;
+    __uint64_t cycles;
+    char detail[240];
+} Result;
+
+typedef struct Job
+{
+    pid_t pid;
+    int pipe;
+    int test;
+} Job;
+
+static Test *tests;
+static int test_count;
+static int test_capacity;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_test(const char *path, __uint64_t timeout, bool has_hash, __uint64_t hash)
+{
+    if (test_count == test_capacity)
+    {
+        test_capacity = test_capacity ? test_capacity * 2 : 64;
+        tests = realloc(tests, test_capacity * sizeof(Test));
+    }
+    tests[test_count++] = (Test){strdup(path), timeout, hash, has_hash};
+}
+
+static int compare_tests(const void *a, const void *b)
+{
+    return strcmp(((const Test *)a)->path, ((const Test *)b)->path);
+}
+
+static void add_path(const char *path, __uint64_t timeout)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        add_test(path, timeout, false, 0);
+        return;
+    }
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL)
+    {
+        char child[4096];
+        size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0 && S_ISDIR(st.st_mode))
+            add_path(child, timeout);
+        else if (length > 3 && strcmp(entry->d_name + length - 3, ".gb") == 0)
+            add_test(child, timeout, false, 0);
+    }
+    if (dir)
+        closedir(dir);
+}
+
+static void read_list(const char *path, __uint64_t timeout)
+{
+    FILE *in = fopen(path, "r");
+    char line[4096];
+    if (in == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), in))
+    {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        char *rom = strtok(line, " \t\r\n");
+        if (rom == NULL)
+            continue;
+        __uint64_t rom_timeout = timeout;
+        bool has_hash = false;
+        __uint64_t hash = 0;
+        for (char *option; (option = strtok(NULL, " \t\r\n"));)
+        {
+            if (strncmp(option, "timeout=", 8) == 0)
+                rom_timeout = strtoull(option + 8, NULL, 0);
+            else if (strncmp(option, "hash=", 5) == 0)
+            {
+                hash = strtoull(option + 5, NULL, 16);
+                has_hash = true;
+            }
+            else
+            {
+                printf("%s: unknown option %s for %s\n", path, option, rom);
+                exit(1);
+            }
+        }
+        add_test(rom, rom_timeout, has_hash, hash);
+    }
+    fclose(in);
+}
+
+// The last line of what the ROM printed, for the report
+static void last_line(const char *text, char *out, size_t size)
+{
+    const char *end = text + strlen(text);
+    while (end > text && (end[-1] == '\n' || end[-1] == ' '))
+        end--;
+    const char *start = end;
+    while (start > text && start[-1] != '\n')
+        start--;
+    snprintf(out, size, "%.*s", (int)(end - start), start);
+}
+
+// at_frame is set when CPU_start stopped right at a frame boundary
+static bool check(CPU *cpu, Serial *serial, const Test *test, bool at_frame, Result *result)
+{
+    Registers *r = &cpu->registers;
+    Cartridge *cart = cpu->cartridge;
+
+    if (strstr(serial->output, "Passed") || strstr(serial->output, "Failed"))
+    {
+        result->status = strstr(serial->output, "Failed") ? RESULT_FAIL : RESULT_PASS;
+        last_line(serial->output, result->detail, sizeof(result->detail));
+        return true;
+    }
+    if (cart->ram_data && cart->ram_size >= 4 && cart->ram_data[1] == 0xDE && cart->ram_data[2] == 0xB0 &&
+        cart->ram_data[3] == 0x61 && cart->ram_data[0] != 0x80)
+    {
+        result->status = cart->ram_data[0] == 0 ? RESULT_PASS : RESULT_FAIL;
+        last_line((const char *)cart->ram_data + 4, result->detail, sizeof(result->detail));
+        return true;
+    }
+    if (r->B == 3 && r->C == 5 && r->D == 8 && r->E == 13 && r->H == 21 && r->L == 34)
+    {
+        result->status = RESULT_PASS;
+        snprintf(result->detail, sizeof(result->detail), "mooneye registers");
+        return true;
+    }
+    if (r->B == 0x42 && r->C == 0x42 && r->D == 0x42 && r->E == 0x42 && r->H == 0x42 && r->L == 0x42)
+    {
+        result->status = RESULT_FAIL;
+        snprintf(result->detail, sizeof(result->detail), "mooneye registers 0x42");
+        return true;
+    }
+    if (test->has_hash && at_frame && state_frame_hash(cpu) == test->hash)
+    {
+        result->status = RESULT_PASS;
+        snprintf(result->detail, sizeof(result->detail), "frame hash %016lx", test->hash);
+        return true;
+    }
+    return false;
+}
+
+static void run_test(const Test *test, Result *result)
+{
+    CPU *cpu = calloc(1, sizeof(CPU));
+    Fetcher *fetcher = calloc(1, sizeof(Fetcher));
+    Serial *serial = serial_init(cpu);
+
+    CPU_init(cpu, fetcher, test->path, NULL);
+    cpu->serial = serial;
+    result->status = RESULT_TIMEOUT;
+    while (cpu->cycles < test->timeout)
+    {
+        __uint64_t frames = cpu->frames;
+        cpu->cycle_limit = cpu->cycles + SLICE_CYCLES;
+        cpu->frame_limit = test->has_hash ? frames + 1 : 0;
+        CPU_start(cpu, NULL);
+        if (check(cpu, serial, test, cpu->frames != frames, result))
+            break;
+    }
+    if (result->status == RESULT_TIMEOUT)
+        last_line(serial->output, result->detail, sizeof(result->detail));
+    result->cycles = cpu->cycles;
+}
+
+static Job start(int test)
+{
+    int fds[2];
+    Job job = {0, -1, test};
+
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    job.pid = fork();
+    if (job.pid < 0)
+    {
+        perror("fork");
+        exit(1);
+    }
+    if (job.pid == 0)
+    {
+        Result result = {0};
+        close(fds[0]);
+        freopen("/dev/null", "w", stdout); // the emulator's own messages
+        run_test(&tests[test], &result);
+        write(fds[1], &result, sizeof(result));
+        _exit(0);
+    }
+    close(fds[1]);
+    job.pipe = fds[0];
+    return job;
+}
+
+static Status finish(Job *job, double seconds)
+{
+    Result result = {RESULT_CRASH, 0, ""};
+    int wstatus;
+
+    if (read(job->pipe, &result, sizeof(result)) != sizeof(result))
+    {
+        result.status = RESULT_CRASH;
+        snprintf(result.detail, sizeof(result.detail), "no result");
+    }
+    close(job->pipe);
+    waitpid(job->pid, &wstatus, 0);
+    if (WIFSIGNALED(wstatus))
+        snprintf(result.detail, sizeof(result.detail), "killed by signal %d", WTERMSIG(wstatus));
+    else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) != 0)
+        snprintf(result.detail, sizeof(result.detail), "exited with %d", WEXITSTATUS(wstatus));
+    printf("%-7s %8.1fM cycles %6.2fs  %s", status_names[result.status], result.cycles / 1e6, seconds,
+           tests[job->test].path);
+    if (result.detail[0])
+        printf("  (%s)", result.detail);
+    printf("\n");
+    return result.status;
+}
+
+int main(int argc, char **argv)
+{
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    __uint64_t timeout = DEFAULT_TIMEOUT;
+    const char *list = NULL;
+    bool usage = false;
+    const char **paths = calloc(argc, sizeof(char *));
+    int path_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+            timeout = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+            list = argv[++i];
+        else if (argv[i][0] == '-')
+            usage = true;
+        else
+            paths[path_count++] = argv[i];
+    }
+    if (list)
+        read_list(list, timeout);
+    for (int i = 0; i < path_count; i++)
+        add_path(paths[i], timeout);
+    if (usage || test_count == 0 || jobs < 1)
+    {
+        printf("Usage: %s [-j JOBS] [--timeout CYCLES] [--list FILE] [ROM|DIR...]\n", argv[0]);
+        return 2;
+    }
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+    qsort(tests, test_count, sizeof(Test), compare_tests);
+
+    Job running[MAX_JOBS];
+    double started[MAX_JOBS];
+    int active = 0, next = 0;
+    int counts[4] = {0};
+    double begin = now();
+    while (next < test_count || active)
+    {
+        while (active < jobs && next < test_count)
+        {
+            started[active] = now();
+            running[active++] = start(next++);
+        }
+        // a worker's pipe becomes readable when it sends its result or dies
+        struct pollfd fds[MAX_JOBS];
+        for (int i = 0; i < active; i++)
+            fds[i] = (struct pollfd){running[i].pipe, POLLIN, 0};
+        poll(fds, active, -1);
+        for (int i = 0; i < active; i++)
+        {
+            if (!fds[i].revents)
+                continue;
+            counts[finish(&running[i], now() - started[i])]++;
+            running[i] = running[active - 1];
+            started[i] = started[active - 1];
+            fds[i] = fds[active - 1];
+            active--;
+            i--;
+        }
+    }
+    printf("%d passed, %d failed, %d timed out, %d crashed in %.2fs on %ld jobs\n", counts[RESULT_PASS],
+           counts[RESULT_FAIL], counts[RESULT_TIMEOUT], counts[RESULT_CRASH], now() - begin, jobs);
+    return counts[RESULT_PASS] == test_count ? 0 : 1;
+}
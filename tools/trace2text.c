@@ -0,0 +1,52 @@
+// Renders a binary trace (emu --trace, TRACE builds) as a Gameboy Doctor
+// log: trace2text trace.bin [out.txt]
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace_format.h"
+#define RECORDS_PER_READ 65536
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s trace.bin [out.txt]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror("Error opening trace");
+        return 1;
+    }
+    FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (out == NULL)
+    {
+        perror("Error opening output");
+        return 1;
+    }
+
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+    {
+        printf("%s is not a binary trace\n", argv[1]);
+        return 1;
+    }
+
+    TraceRecord *records = malloc(RECORDS_PER_READ * sizeof(TraceRecord));
+    char *text = malloc(RECORDS_PER_READ * TRACE_TEXT_LENGTH + 1);
+    size_t count;
+    while ((count = fread(records, sizeof(TraceRecord), RECORDS_PER_READ, in)) > 0)
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++)
+            length += trace_format(&records[i], text + length);
+        fwrite(text, 1, length, out);
+    }
+
+    free(records);
+    free(text);
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
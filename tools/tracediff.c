@@ -0,0 +1,249 @@
+// Compares two instruction traces record by record and stops at the first
+// difference: tracediff [-c LINES] [--no-pcmem] ours reference
+//
+// Either file can be a binary trace (emu --trace) or a Gameboy Doctor text
+// log. Both are mmap'd and parsed in place, so multi-gigabyte logs stream
+// at disk speed.
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace_format.h"
+#define MAX_CONTEXT 64
+
+typedef struct TraceFile
+{
+    const char *path;
+    const char *data;
+    size_t size;
+    size_t offset;
+    bool binary;
+    __uint64_t line; // 1-based line of the record last read from a text log
+} TraceFile;
+
+static void open_trace(TraceFile *trace, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        exit(2);
+    }
+
+    trace->path = path;
+    trace->size = st.st_size;
+    trace->data = "";
+    if (trace->size)
+    {
+        trace->data = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (trace->data == MAP_FAILED)
+        {
+            perror(path);
+            exit(2);
+        }
+        madvise((void *)trace->data, trace->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    size_t magic = strlen(TRACE_MAGIC);
+    trace->binary = trace->size >= magic && memcmp(trace->data, TRACE_MAGIC, magic) == 0;
+    trace->offset = trace->binary ? magic : 0;
+}
+
+static signed char hex_digits[256];
+
+static void init_hex_digits(void)
+{
+    memset(hex_digits, -1, sizeof(hex_digits));
+    for (int i = 0; i < 10; i++)
+        hex_digits['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+        hex_digits['A' + i] = hex_digits['a' + i] = 10 + i;
+}
+
+// Reads count hex digits at p, false if any isn't one
+static bool parse_hex(const char *p, int count, unsigned int *value)
+{
+    int bad = 0;
+    *value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int digit = hex_digits[(unsigned char)p[i]];
+        bad |= digit;
+        *value = *value << 4 | (digit & 0xF);
+    }
+    return bad >= 0;
+}
+
+// "A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,50,01"
+static bool parse_line(const char *p, size_t length, TraceRecord *r)
+{
+    static const int byte_fields[8] = {2, 7, 12, 17, 22, 27, 32, 37};
+    unsigned int value;
+
+    if (length < TRACE_TEXT_LENGTH - 1)
+        return false;
+    __uint8_t *registers = &r->A;
+    for (int i = 0; i < 8; i++)
+    {
+        if (!parse_hex(p + byte_fields[i], 2, &value))
+            return false;
+        registers[i] = value;
+    }
+    if (!parse_hex(p + 43, 4, &value))
+        return false;
+    r->SP = value;
+    if (!parse_hex(p + 51, 4, &value))
+        return false;
+    r->PC = value;
+    for (int i = 0; i < 4; i++)
+    {
+        if (!parse_hex(p + 62 + 3 * i, 2, &value))
+            return false;
+        r->pcmem[i] = value;
+    }
+    return true;
+}
+
+// Next record, false at the end of the trace. Text lines that aren't
+// records (blank lines, emulator chatter) are skipped.
+static bool next_record(TraceFile *trace, TraceRecord *r)
+{
+    if (trace->binary)
+    {
+        if (trace->size - trace->offset < sizeof(TraceRecord))
+            return false;
+        memcpy(r, trace->data + trace->offset, sizeof(TraceRecord));
+        trace->offset += sizeof(TraceRecord);
+        return true;
+    }
+
+    while (trace->offset < trace->size)
+    {
+        const char *line = trace->data + trace->offset;
+        size_t left = trace->size - trace->offset;
+        size_t length = TRACE_TEXT_LENGTH - 1;
+        if (left <= length || line[length] != '\n')
+        {
+            const char *end = memchr(line, '\n', left);
+            length = end ? (size_t)(end - line) : left;
+        }
+        trace->offset += length + 1;
+        trace->line++;
+        if (parse_line(line, length, r))
+            return true;
+    }
+    return false;
+}
+
+static void print_record(const char *prefix, const TraceRecord *r)
+{
+    char text[TRACE_TEXT_LENGTH + 1];
+    trace_format(r, text);
+    printf("%s%s", prefix, text);
+}
+
+static void print_fields(const TraceRecord *ours, const TraceRecord *reference, bool pcmem)
+{
+    static const char *names[8] = {"A", "F", "B", "C", "D", "E", "H", "L"};
+
+    printf("differs in:");
+    for (int i = 0; i < 8; i++)
+    {
+        if ((&ours->A)[i] != (&reference->A)[i])
+            printf(" %s", names[i]);
+    }
+    if (ours->SP != reference->SP)
+        printf(" SP");
+    if (ours->PC != reference->PC)
+        printf(" PC");
+    if (pcmem && memcmp(ours->pcmem, reference->pcmem, sizeof(ours->pcmem)) != 0)
+        printf(" PCMEM");
+    printf("\n");
+}
+
+static bool same(const TraceRecord *a, const TraceRecord *b, bool pcmem)
+{
+    return memcmp(a, b, pcmem ? sizeof(TraceRecord) : offsetof(TraceRecord, pcmem)) == 0;
+}
+
+static void location(TraceFile *trace)
+{
+    if (!trace->binary)
+        printf(" (%s line %lu)", trace->path, trace->line);
+}
+
+int main(int argc, char **argv)
+{
+    int context = 5;
+    bool pcmem = true;
+    const char *paths[2];
+    int files = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            context = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-pcmem") == 0)
+            pcmem = false;
+        else if (files < 2)
+            paths[files++] = argv[i];
+    }
+    if (files != 2)
+    {
+        printf("Usage: %s [-c LINES] [--no-pcmem] ours reference\n", argv[0]);
+        return 2;
+    }
+    if (context < 0)
+        context = 0;
+    if (context > MAX_CONTEXT)
+        context = MAX_CONTEXT;
+
+    init_hex_digits();
+    TraceFile ours = {0}, reference = {0};
+    open_trace(&ours, paths[0]);
+    open_trace(&reference, paths[1]);
+
+    TraceRecord history[MAX_CONTEXT];
+    TraceRecord a, b;
+    __uint64_t record = 0;
+    for (;; record++)
+    {
+        bool more_ours = next_record(&ours, &a);
+        bool more_reference = next_record(&reference, &b);
+        if (!more_ours || !more_reference)
+        {
+            if (more_ours == more_reference)
+            {
+                printf("Traces match (%lu records)\n", record);
+                return 0;
+            }
+            printf("%s ends after %lu records, %s continues with\n",
+                   more_ours ? paths[1] : paths[0], record, more_ours ? paths[0] : paths[1]);
+            print_record("  ", more_ours ? &a : &b);
+            return 1;
+        }
+        if (!same(&a, &b, pcmem))
+            break;
+        if (context)
+            history[record % context] = a;
+    }
+
+    printf("First difference at record %lu", record);
+    location(&ours);
+    location(&reference);
+    printf("\n");
+    __uint64_t first = record > (__uint64_t)context ? record - context : 0;
+    for (__uint64_t i = first; i < record; i++)
+        print_record("  ", &history[i % context]);
+    print_record("- ", &b);
+    print_record("+ ", &a);
+    print_fields(&a, &b, pcmem);
+    return 1;
+}